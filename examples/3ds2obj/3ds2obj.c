@@ -153,6 +153,7 @@ void write_mesh(FILE *o, Lib3dsFile *f, Lib3dsMeshInstanceNode *node) {
     int export_normals;
     int i, j;
     Lib3dsMesh *mesh;
+    Lib3dsMeshIndexed *indexed = NULL;
         
     mesh = lib3ds_file_mesh_for_node(f, (Lib3dsNode*)node);
     if (!mesh || !mesh->vertices) return;
@@ -198,15 +199,13 @@ void write_mesh(FILE *o, Lib3dsFile *f, Lib3dsMeshInstanceNode *node) {
     }
 
     if (export_normals) {
-        float (*normals)[3] = (float(*)[3])malloc(sizeof(float) * 9 * mesh->nfaces);
-        lib3ds_mesh_calculate_vertex_normals(mesh, normals);
-        for (i = 0; i < 3 * mesh->nfaces; ++i) {
-            fprintf(o, "vn %f %f %f\n", normals[i][0],
-                                        normals[i][1],
-                                        normals[i][2]);
+        indexed = lib3ds_mesh_indexed_new(mesh, 0);
+        for (i = 0; i < indexed->nvertices; ++i) {
+            fprintf(o, "vn %f %f %f\n", indexed->normals[i][0],
+                                        indexed->normals[i][1],
+                                        indexed->normals[i][2]);
         }
-        free(normals);  
-        fprintf(o, "# %d normals\n", 3 * mesh->nfaces);
+        fprintf(o, "# %d normals\n", indexed->nvertices);
     }
 
     {
@@ -228,7 +227,7 @@ void write_mesh(FILE *o, Lib3dsFile *f, Lib3dsMeshInstanceNode *node) {
                     fprintf(o, "/");
                 }
                 if (export_normals) {
-                    fprintf(o, "/%d", 3 * i + j + max_normals + 1);
+                    fprintf(o, "/%d", indexed->indices[3 * i + j] + max_normals + 1);
                 }
                 if (j < 3) {
                     fprintf(o, " ");
@@ -241,8 +240,10 @@ void write_mesh(FILE *o, Lib3dsFile *f, Lib3dsMeshInstanceNode *node) {
     max_vertices += mesh->nvertices;
     if (export_texcos) 
         max_texcos += mesh->nvertices;
-    if (export_normals) 
-        max_normals += 3 * mesh->nfaces;
+    if (export_normals) {
+        max_normals += indexed->nvertices;
+        lib3ds_mesh_indexed_free(indexed);
+    }
     
     memcpy(mesh->vertices, orig_vertices, sizeof(float) * 3 * mesh->nvertices);
     free(orig_vertices);
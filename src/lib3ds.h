@@ -57,6 +57,16 @@ typedef enum Lib3dsLogLevel {
     LIB3DS_LOG_DEBUG    = 3
 } Lib3dsLogLevel;
 
+typedef enum Lib3dsIoFlags {
+    LIB3DS_IO_LAZY_MESHES   = 0x0001,   /**< Defer reading of mesh geometry, see lib3ds_mesh_load() */
+    LIB3DS_IO_STICKY_ERRORS = 0x0002,   /**< Record errors in Lib3dsIo::error and unwind normally instead of using longjmp */
+    LIB3DS_IO_MERGE_MESHES  = 0x0004,   /**< Merge meshes split on writing ("name", "name#1", ...) back into one */
+    LIB3DS_IO_LOG_LEVEL     = 0x0008    /**< Pass only messages up to Lib3dsIo::log_level to log_func */
+} Lib3dsIoFlags;
+
+/** Stream used for reading and writing files. seek_func and tell_func 
+    may be NULL for reading from forward-only streams (pipes, sockets), 
+    writing requires seeking unless lib3ds_file_write_buffered() is used. */
 typedef struct Lib3dsIo {
     void*   impl;
     void*   self;
@@ -65,8 +75,30 @@ typedef struct Lib3dsIo {
     size_t  (*read_func) (void *self, void *buffer, size_t size);
     size_t  (*write_func)(void *self, const void *buffer, size_t size);
     void    (*log_func)  (void *self, Lib3dsLogLevel level, int indent, const char *msg);
+    unsigned flags;     /**< @see Lib3dsIoFlags */
+    Lib3dsLogLevel log_level;   /**< Most verbose level passed to log_func if LIB3DS_IO_LOG_LEVEL is set, messages above are not formatted */
+    void    (*log_chunk_func)(void *self, unsigned short chunk, long offset, unsigned size, int depth);  /**< Called for every chunk read, optional */
+    int     error;      /**< Set if an error occurred during the last read or write, reset when it starts */
 } Lib3dsIo;
 
+/** In-memory stream used as Lib3dsIo::self by lib3ds_io_init_memory() 
+    and lib3ds_io_init_memory_buffer() */
+typedef struct Lib3dsIoMemory {
+    unsigned char*  data;
+    size_t          size;       /**< Number of bytes in data */
+    size_t          capacity;   /**< Allocated size of data, 0 if data is caller owned and read-only */
+    size_t          pos;        /**< Current stream position */
+} Lib3dsIoMemory;
+
+/** Memory allocation functions used by lib3ds, see lib3ds_util_set_allocator().
+    realloc_func and free_func are never called with a NULL pointer. */
+typedef struct Lib3dsAllocator {
+    void*   self;
+    void*   (*alloc_func)  (void *self, size_t size);
+    void*   (*realloc_func)(void *self, void *ptr, size_t size);
+    void    (*free_func)   (void *self, void *ptr);
+} Lib3dsAllocator;
+
 /* Atmosphere settings */
 typedef struct Lib3dsAtmosphere {
     int         use_fog;
@@ -353,7 +385,7 @@ typedef enum Lib3dsFaceFlags {
 } Lib3dsFaceFlags;
 
 typedef struct Lib3dsFace {
-    unsigned short  index[3];
+    unsigned        index[3];
     unsigned short  flags;
     int             material;
     unsigned        smoothing_group;
@@ -367,11 +399,11 @@ typedef struct Lib3dsMesh {
     unsigned        object_flags;        /**< @see Lib3dsObjectFlags */ 
     int             color;               /**< Index to editor palette [0..255] */
     float           matrix[4][4];        /**< Transformation matrix for mesh data */
-    unsigned short  nvertices;           /**< Number of vertices in vertex array (max. 65535) */
+    int             nvertices;           /**< Number of vertices in vertex array, meshes above 65535 are split when written */
     float           (*vertices)[3];
     float           (*texcos)[2];
     unsigned short* vflags;
-    unsigned short  nfaces;              /**< Number of faces in face array (max. 65535) */
+    int             nfaces;              /**< Number of faces in face array, meshes above 65535 are split when written */
     Lib3dsFace*     faces;               
     char            box_front[64];
     char            box_back[64];
@@ -386,8 +418,44 @@ typedef struct Lib3dsMesh {
     float           map_tile[2];
     float           map_planar_size[2];
     float           map_cylinder_height;
+    unsigned        data_offset;         /**< Stream offset of the mesh data if read with LIB3DS_IO_LAZY_MESHES, 0 otherwise */
 } Lib3dsMesh; 
 
+#define LIB3DS_SOA_WIDTH 8
+
+/** Structure of arrays copy of the geometry of a mesh for batch 
+    processing, see lib3ds_mesh_soa_new(). The coordinate arrays are
+    aligned to and padded up to a multiple of LIB3DS_SOA_WIDTH floats. */
+typedef struct Lib3dsMeshSoa {
+    int             nvertices;
+    int             capacity;            /**< Length of x, y and z, padded with copies of the last vertex */
+    float*          x;
+    float*          y;
+    float*          z;
+    int             nfaces;
+    unsigned*       indices;             /**< Vertex indices of the faces, 3 per face */
+    int*            material;
+    unsigned*       smoothing_group;
+    void*           data;                /**< Memory block holding all arrays */
+} Lib3dsMeshSoa;
+
+/** Indexed vertex stream of a mesh with smooth normals, see 
+    lib3ds_mesh_indexed_new(). */
+typedef struct Lib3dsMeshIndexed {
+    int             nvertices;
+    float           (*positions)[3];
+    float           (*texcos)[2];        /**< NULL if the mesh has no texture coordinates */
+    float           (*normals)[3];
+    int*            source;              /**< Mesh vertex each vertex was created from */
+    int             nfaces;
+    unsigned*       indices;             /**< Vertex indices of the faces, 3 per face */
+} Lib3dsMeshIndexed;
+
+typedef enum Lib3dsWeldFlags {
+    LIB3DS_WELD_TEXCOS      = 0x0001,   /**< Texture coordinates have to be within epsilon as well */
+    LIB3DS_WELD_KEEP_FACES  = 0x0002    /**< Keep degenerate and duplicate faces */
+} Lib3dsWeldFlags;
+
 typedef enum Lib3dsNodeType {
     LIB3DS_NODE_AMBIENT_COLOR   = 0,
     LIB3DS_NODE_MESH_INSTANCE   = 1,
@@ -456,11 +524,18 @@ typedef enum {
     LIB3DS_TRACK_UNLINK_Z = 0x0400
 } Lib3dsTrackFlags;
 
+typedef struct Lib3dsTrackCache Lib3dsTrackCache;
+
+/** Keys edited in place after the track was compiled require a call
+    of lib3ds_track_invalidate(), lib3ds_track_resize() does so itself. */
 typedef struct Lib3dsTrack {
     unsigned        flags;
     Lib3dsTrackType type; 
     int             nkeys;
     Lib3dsKey*      keys;   
+    Lib3dsTrackCache* cache;    /**< Data derived from the keys for evaluation, NULL unless compiled. See lib3ds_track_compile() */
+    int             use_cursor; /**< Non-zero if evaluations start at cursor. See lib3ds_track_use_cursor() */
+    int             cursor;     /**< Segment found by the last evaluation if use_cursor is set, 0 if none */
 } Lib3dsTrack;
 
 typedef struct Lib3dsAmbientColorNode {
@@ -525,6 +600,9 @@ typedef struct Lib3dsSpotlightNode {
     Lib3dsTrack     roll_track;
 } Lib3dsSpotlightNode;
 
+/** Opaque block allocator, see lib3ds_file_new_arena() */
+typedef struct Lib3dsArena Lib3dsArena;
+
 typedef struct Lib3dsFile {
     unsigned            user_id;
     void*               user_ptr;
@@ -556,15 +634,99 @@ typedef struct Lib3dsFile {
     int                 nmeshes;                      
     Lib3dsMesh**        meshes;                         
     Lib3dsNode*         nodes;
+    Lib3dsArena*        arena;      /**< Owns the memory of everything read into the file, NULL unless created by lib3ds_file_new_arena() */
 } Lib3dsFile; 
 
+/** Record of a node in a Lib3dsBake */
+typedef struct Lib3dsBakeNode {
+    Lib3dsNode*     node;
+    int             parent;     /**< Index of the parent node, -1 for root nodes */
+    int             offset;     /**< Position of the record within a frame */
+    int             size;       /**< Number of floats of the record */
+} Lib3dsBakeNode;
+
+/** Node values sampled by lib3ds_file_bake(). Frame k is at time 
+    from + k * step, its values start at data + k * stride. The nodes are
+    stored depth first, parents before their children. The record of a 
+    node starts with its world matrix (16 floats, as Lib3dsNode.matrix),
+    followed by
+      - LIB3DS_NODE_AMBIENT_COLOR: color[3]
+      - LIB3DS_NODE_MESH_INSTANCE: hide (0 or 1)
+      - LIB3DS_NODE_CAMERA: fov, roll
+      - LIB3DS_NODE_OMNILIGHT: color[3]
+      - LIB3DS_NODE_SPOTLIGHT: color[3], hotspot, falloff, roll */
+typedef struct Lib3dsBake {
+    float           from;
+    float           step;
+    int             nframes;
+    int             nnodes;
+    Lib3dsBakeNode* nodes;
+    int             stride;     /**< Number of floats per frame */
+    float*          data;
+} Lib3dsBake;
+
+/** Chunk ids recorded in a Lib3dsChunkIndex */
+typedef enum Lib3dsChunkId {
+    LIB3DS_CHUNK_M3DMAGIC           = 0x4D4D,
+    LIB3DS_CHUNK_MDATA              = 0x3D3D,
+    LIB3DS_CHUNK_MAT_ENTRY          = 0xAFFF,
+    LIB3DS_CHUNK_NAMED_OBJECT       = 0x4000,
+    LIB3DS_CHUNK_N_TRI_OBJECT       = 0x4100,
+    LIB3DS_CHUNK_N_DIRECT_LIGHT     = 0x4600,
+    LIB3DS_CHUNK_N_CAMERA           = 0x4700,
+    LIB3DS_CHUNK_KFDATA             = 0xB000,
+    LIB3DS_CHUNK_AMBIENT_NODE_TAG   = 0xB001,
+    LIB3DS_CHUNK_OBJECT_NODE_TAG    = 0xB002,
+    LIB3DS_CHUNK_CAMERA_NODE_TAG    = 0xB003,
+    LIB3DS_CHUNK_TARGET_NODE_TAG    = 0xB004,
+    LIB3DS_CHUNK_LIGHT_NODE_TAG     = 0xB005,
+    LIB3DS_CHUNK_L_TARGET_NODE_TAG  = 0xB006,
+    LIB3DS_CHUNK_SPOTLIGHT_NODE_TAG = 0xB007
+} Lib3dsChunkId;
+
+typedef struct Lib3dsChunkIndexEntry {
+    unsigned short  chunk;
+    int             parent;     /**< Index of the enclosing entry, -1 for the file chunk */
+    unsigned        offset;     /**< Stream offset of the chunk header */
+    unsigned        size;       /**< Chunk size including the header */
+} Lib3dsChunkIndexEntry;
+
+/** Table of the chunk headers of a file, see lib3ds_chunk_index_new() */
+typedef struct Lib3dsChunkIndex {
+    int                     entries_size;
+    int                     nentries;
+    Lib3dsChunkIndexEntry*  entries;
+    int*                    node_lookup;    /**< Node id lookup of lib3ds_chunk_index_load_nodes(), NULL until first used */
+} Lib3dsChunkIndex;
+
+/** Callbacks for lib3ds_file_read_callbacks(). Each function receives 
+    a fully decoded object and returns non-zero to take ownership of it, 
+    zero to have it freed. A NULL function keeps the objects in the file 
+    as lib3ds_file_read() does. */
+typedef struct Lib3dsReadCallbacks {
+    void*   self;
+    int     (*material_func)(void *self, Lib3dsMaterial *material);
+    int     (*mesh_func)    (void *self, Lib3dsMesh *mesh);
+    int     (*camera_func)  (void *self, Lib3dsCamera *camera);
+    int     (*light_func)   (void *self, Lib3dsLight *light);
+    int     (*node_func)    (void *self, Lib3dsNode *node, unsigned short parent_id);
+} Lib3dsReadCallbacks;
+
 extern LIB3DSAPI Lib3dsFile* lib3ds_file_open(const char *filename);
+extern LIB3DSAPI Lib3dsFile* lib3ds_file_open_mmap(const char *filename);
 extern LIB3DSAPI int lib3ds_file_save(Lib3dsFile *file, const char *filename);
 extern LIB3DSAPI Lib3dsFile* lib3ds_file_new();
+extern LIB3DSAPI Lib3dsFile* lib3ds_file_new_arena(size_t block_size);
 extern LIB3DSAPI void lib3ds_file_free(Lib3dsFile *file);
 extern LIB3DSAPI void lib3ds_file_eval(Lib3dsFile *file, float t);
+extern LIB3DSAPI Lib3dsBake* lib3ds_file_bake(Lib3dsFile *file, float from, float to, float step, int nthreads);
+extern LIB3DSAPI void lib3ds_file_bake_free(Lib3dsBake *bake);
 extern LIB3DSAPI int lib3ds_file_read(Lib3dsFile *file, Lib3dsIo *io);
+extern LIB3DSAPI int lib3ds_file_read_callbacks(Lib3dsFile *file, Lib3dsIo *io, Lib3dsReadCallbacks *callbacks);
+extern LIB3DSAPI int lib3ds_file_read_parallel(Lib3dsFile *file, Lib3dsIo *io, int nthreads);
 extern LIB3DSAPI int lib3ds_file_write(Lib3dsFile *file, Lib3dsIo *io);
+extern LIB3DSAPI int lib3ds_file_read_memory(Lib3dsFile *file, const void *data, size_t size);
+extern LIB3DSAPI int lib3ds_file_write_buffered(Lib3dsFile *file, Lib3dsIo *io);
 extern LIB3DSAPI void lib3ds_file_reserve_materials(Lib3dsFile *file, int size, int force);
 extern LIB3DSAPI void lib3ds_file_insert_material(Lib3dsFile *file, Lib3dsMaterial *material, int index);
 extern LIB3DSAPI void lib3ds_file_remove_material(Lib3dsFile *file, int index);
@@ -632,6 +794,69 @@ extern LIB3DSAPI void lib3ds_file_bounding_box_of_nodes(
     float bmax[3], 
     float matrix[4][4]);
 
+/**
+    Sets up a Lib3dsIo object reading from a block of memory. The memory
+    is accessed in place and must stay valid as long as the Lib3dsIo
+    object is used. The primitive readers recognise this backend and
+    decode directly from the buffer.
+
+    \param io       The Lib3dsIo object to be initialized.
+    \param mem      Stream state, must stay valid as long as io is used.
+    \param data     The .3DS file data.
+    \param size     Size of data in bytes.
+ */
+extern LIB3DSAPI void lib3ds_io_init_memory(
+    Lib3dsIo *io,
+    Lib3dsIoMemory *mem,
+    const void *data,
+    size_t size);
+
+/**
+    Sets up a Lib3dsIo object writing to a growable block of memory.
+    Seeking is supported, so chunk sizes are patched in place. The
+    written data is found in mem->data and mem->size afterwards and 
+    has to be released with lib3ds_io_free_memory_buffer().
+
+    \param io       The Lib3dsIo object to be initialized.
+    \param mem      Stream state, must stay valid as long as io is used.
+ */
+extern LIB3DSAPI void lib3ds_io_init_memory_buffer(
+    Lib3dsIo *io,
+    Lib3dsIoMemory *mem);
+
+extern LIB3DSAPI void lib3ds_io_free_memory_buffer(Lib3dsIoMemory *mem);
+
+/**
+    Routes every allocation of lib3ds, including temporary buffers, 
+    arena blocks and memory streams, through the given functions. Has
+    to be called before any lib3ds object is created, the functions 
+    must be thread-safe if lib3ds is used from several threads.
+
+    \param allocator   The allocator, copied. NULL restores malloc, 
+                        realloc and free.
+ */
+extern LIB3DSAPI void lib3ds_util_set_allocator(const Lib3dsAllocator *allocator);
+extern LIB3DSAPI void lib3ds_util_get_allocator(Lib3dsAllocator *allocator);
+
+/**
+    Builds a table of the chunk headers of a file without decoding any
+    chunk data. The file, MDATA and KFDATA chunks and the NAMED_OBJECT 
+    chunks are descended into, all other chunks are recorded and skipped. 
+    The accessors below use the offsets to load single materials, 
+    objects or node hierarchies later, which requires a seekable io.
+
+    \param io      A Lib3dsIo object previously set up by the caller.
+
+    \return The index or NULL on failure, free with lib3ds_chunk_index_free().
+ */
+extern LIB3DSAPI Lib3dsChunkIndex* lib3ds_chunk_index_new(Lib3dsIo *io);
+extern LIB3DSAPI void lib3ds_chunk_index_free(Lib3dsChunkIndex *index);
+extern LIB3DSAPI int lib3ds_chunk_index_find(Lib3dsChunkIndex *index, int chunk, int start);
+extern LIB3DSAPI int lib3ds_chunk_index_read_name(Lib3dsChunkIndex *index, Lib3dsIo *io, int entry, char name[64]);
+extern LIB3DSAPI Lib3dsMaterial* lib3ds_chunk_index_load_material(Lib3dsChunkIndex *index, Lib3dsIo *io, int entry);
+extern LIB3DSAPI int lib3ds_chunk_index_load_object(Lib3dsChunkIndex *index, Lib3dsIo *io, int entry, Lib3dsFile *file);
+extern LIB3DSAPI Lib3dsNode* lib3ds_chunk_index_load_nodes(Lib3dsChunkIndex *index, Lib3dsIo *io, int entry, Lib3dsFile *file);
+
 extern LIB3DSAPI Lib3dsMaterial* lib3ds_material_new(const char *name);
 extern LIB3DSAPI void lib3ds_material_free(Lib3dsMaterial *material);
 extern LIB3DSAPI Lib3dsCamera* lib3ds_camera_new(const char *name);
@@ -642,9 +867,26 @@ extern LIB3DSAPI Lib3dsMesh* lib3ds_mesh_new(const char *name);
 extern LIB3DSAPI void lib3ds_mesh_free(Lib3dsMesh *mesh);
 extern LIB3DSAPI void lib3ds_mesh_resize_vertices(Lib3dsMesh *mesh, int nvertices, int use_texcos, int use_flags);
 extern LIB3DSAPI void lib3ds_mesh_resize_faces(Lib3dsMesh *mesh, int nfaces);
+extern LIB3DSAPI int lib3ds_mesh_load(Lib3dsFile *file, Lib3dsMesh *mesh, Lib3dsIo *io);
+extern LIB3DSAPI void lib3ds_mesh_unload(Lib3dsMesh *mesh);
 extern LIB3DSAPI void lib3ds_mesh_bounding_box(Lib3dsMesh *mesh, float bmin[3], float bmax[3]);
 extern LIB3DSAPI void lib3ds_mesh_calculate_face_normals(Lib3dsMesh *mesh, float (*face_normals)[3]);
 extern LIB3DSAPI void lib3ds_mesh_calculate_vertex_normals(Lib3dsMesh *mesh, float (*normals)[3]);
+extern LIB3DSAPI void lib3ds_mesh_calculate_vertex_normals_parallel(Lib3dsMesh *mesh, float (*normals)[3], int nthreads);
+extern LIB3DSAPI Lib3dsMeshIndexed* lib3ds_mesh_indexed_new(Lib3dsMesh *mesh, int nthreads);
+extern LIB3DSAPI void lib3ds_mesh_indexed_free(Lib3dsMeshIndexed *indexed);
+extern LIB3DSAPI float lib3ds_mesh_calculate_acmr(Lib3dsMesh *mesh, int cache_size);
+extern LIB3DSAPI void lib3ds_mesh_optimize(Lib3dsMesh *mesh);
+extern LIB3DSAPI void lib3ds_mesh_optimize_vertex_cache(Lib3dsMesh *mesh, int cache_size);
+extern LIB3DSAPI void lib3ds_mesh_optimize_overdraw(Lib3dsMesh *mesh, int cache_size, float threshold);
+extern LIB3DSAPI void lib3ds_mesh_optimize_vertex_fetch(Lib3dsMesh *mesh);
+extern LIB3DSAPI void lib3ds_mesh_weld(Lib3dsMesh *mesh, float epsilon, unsigned flags);
+extern LIB3DSAPI Lib3dsMeshSoa* lib3ds_mesh_soa_new(Lib3dsMesh *mesh);
+extern LIB3DSAPI void lib3ds_mesh_soa_free(Lib3dsMeshSoa *soa);
+extern LIB3DSAPI void lib3ds_mesh_soa_store(Lib3dsMeshSoa *soa, Lib3dsMesh *mesh);
+extern LIB3DSAPI void lib3ds_mesh_soa_bounding_box(Lib3dsMeshSoa *soa, float bmin[3], float bmax[3]);
+extern LIB3DSAPI void lib3ds_mesh_soa_calculate_face_normals(Lib3dsMeshSoa *soa, float *nx, float *ny, float *nz);
+extern LIB3DSAPI void lib3ds_mesh_soa_transform(Lib3dsMeshSoa *soa, float matrix[4][4]);
 
 extern LIB3DSAPI Lib3dsNode* lib3ds_node_new(Lib3dsNodeType type);
 extern LIB3DSAPI Lib3dsAmbientColorNode* lib3ds_node_new_ambient_color(float color0[3]);
@@ -662,10 +904,17 @@ extern LIB3DSAPI Lib3dsNode* lib3ds_node_by_id(Lib3dsNode *node, unsigned short
 extern LIB3DSAPI Lib3dsTrack* lib3ds_track_new(Lib3dsTrackType type, int nkeys);
 extern LIB3DSAPI void lib3ds_track_free(Lib3dsTrack *track);
 extern LIB3DSAPI void lib3ds_track_resize(Lib3dsTrack *track, int nkeys);
+extern LIB3DSAPI void lib3ds_track_invalidate(Lib3dsTrack *track);
+extern LIB3DSAPI void lib3ds_track_compile(Lib3dsTrack *track);
+extern LIB3DSAPI void lib3ds_track_use_cursor(Lib3dsTrack *track, int enable);
 extern LIB3DSAPI void lib3ds_track_eval_bool(Lib3dsTrack *track, int *b, float t);
 extern LIB3DSAPI void lib3ds_track_eval_float(Lib3dsTrack *track, float *f, float t);
 extern LIB3DSAPI void lib3ds_track_eval_vector(Lib3dsTrack *track, float v[3], float t);
 extern LIB3DSAPI void lib3ds_track_eval_quat(Lib3dsTrack *track, float q[4], float t);
+extern LIB3DSAPI void lib3ds_track_eval_bool_batch(Lib3dsTrack *track, const float *times, int n, int *b);
+extern LIB3DSAPI void lib3ds_track_eval_float_batch(Lib3dsTrack *track, const float *times, int n, float *f);
+extern LIB3DSAPI void lib3ds_track_eval_vector_batch(Lib3dsTrack *track, const float *times, int n, float (*v)[3]);
+extern LIB3DSAPI void lib3ds_track_eval_quat_batch(Lib3dsTrack *track, const float *times, int n, float (*q)[4]);
 
 /** 
     Calculates the ease in/out function. See Lib3dsKey for details. 
@@ -35,7 +35,7 @@ lib3ds_camera_new(const char *name) {
     assert(name);
     assert(strlen(name) < 64);
 
-    camera = (Lib3dsCamera*)calloc(sizeof(Lib3dsCamera), 1);
+    camera = (Lib3dsCamera*)lib3ds_util_calloc(sizeof(Lib3dsCamera));
     if (!camera) {
         return(0);
     }
@@ -53,7 +53,7 @@ lib3ds_camera_new(const char *name) {
 void
 lib3ds_camera_free(Lib3dsCamera *camera) {
     memset(camera, 0, sizeof(Lib3dsCamera));
-    free(camera);
+    lib3ds_util_free(camera);
 }
 
 
@@ -32,15 +32,30 @@
  */
 void
 lib3ds_chunk_read(Lib3dsChunk *c, Lib3dsIo *io) {
+    Lib3dsIoImpl *impl;
+
     assert(c);
     assert(io);
-    c->cur = lib3ds_io_tell(io);
-    c->chunk = lib3ds_io_read_word(io);
-    c->size = lib3ds_io_read_dword(io);
+    impl = (Lib3dsIoImpl*)io->impl;
+    if (impl->header_pending) {
+        /* header was pushed back by lib3ds_chunk_read_reset */
+        impl->header_pending = FALSE;
+        c->cur = impl->header.cur;
+        c->chunk = impl->header.chunk;
+        c->size = impl->header.size;
+    } else {
+        c->cur = lib3ds_io_tell(io);
+        c->chunk = lib3ds_io_read_word(io);
+        c->size = lib3ds_io_read_dword(io);
+        impl->header.cur = c->cur;
+        impl->header.chunk = c->chunk;
+        impl->header.size = c->size;
+    }
     c->end = c->cur + c->size;
     c->cur += 6;
     if (c->size < 6) {
         lib3ds_io_log(io, LIB3DS_LOG_ERROR, "Invalid chunk header.");
+        c->end = c->cur;
     }
 
 }
@@ -64,31 +79,56 @@ lib3ds_chunk_read_tell(Lib3dsChunk *c, Lib3dsIo *io) {
 }
 
 
+/*!
+ * Reads the header of the next sub chunk. The stream is only 
+ * repositioned if the previous sub chunk was not fully consumed.
+ */
 uint16_t
 lib3ds_chunk_read_next(Lib3dsChunk *c, Lib3dsIo *io) {
-    Lib3dsChunk d;
+    Lib3dsIoImpl *impl = (Lib3dsIoImpl*)io->impl;
+    Lib3dsChunk *d = &impl->header;
 
+    if (io->error) {
+        /* only reached with LIB3DS_IO_STICKY_ERRORS, unwinds the readers */
+        return 0;
+    }
     if (c->cur >= c->end) {
         assert(c->cur == c->end);
         return 0;
     }
 
     lib3ds_io_seek(io, (long)c->cur, LIB3DS_SEEK_SET);
-    d.chunk = lib3ds_io_read_word(io);
-    d.size = lib3ds_io_read_dword(io);
-    c->cur += d.size;
+    impl->header_pending = FALSE;
+    d->cur = c->cur;
+    d->chunk = lib3ds_io_read_word(io);
+    d->size = lib3ds_io_read_dword(io);
+    if (d->size < 6) {
+        /* would never advance, e.g. zeros read past a truncated file */
+        lib3ds_io_log(io, LIB3DS_LOG_ERROR, "Invalid chunk header.");
+        return 0;
+    }
+    c->cur += d->size;
 
-    if (io->log_func) {
-        lib3ds_io_log(io, LIB3DS_LOG_INFO, "%s (0x%X) size=%lu", lib3ds_chunk_name(d.chunk), d.chunk, d.size);
+    if (io->log_chunk_func) {
+        (*io->log_chunk_func)(io->self, d->chunk, (long)d->cur, d->size, impl->log_indent);
+    }
+    if (lib3ds_io_log_enabled(io, LIB3DS_LOG_INFO)) {
+        lib3ds_io_log(io, LIB3DS_LOG_INFO, "%s (0x%X) size=%lu", lib3ds_chunk_name(d->chunk), d->chunk, d->size);
     }
 
-    return d.chunk;
+    return d->chunk;
 }
 
 
+/*!
+ * Pushes back the header returned by the last lib3ds_chunk_read_next
+ * or lib3ds_chunk_read call, so the chunk can be read again by 
+ * lib3ds_chunk_read or lib3ds_chunk_read_start without seeking back 
+ * in the stream.
+ */
 void
 lib3ds_chunk_read_reset(Lib3dsChunk *c, Lib3dsIo *io) {
-    lib3ds_io_seek(io, -6, LIB3DS_SEEK_CUR);
+    ((Lib3dsIoImpl*)io->impl)->header_pending = TRUE;
 }
 
 
@@ -138,7 +178,7 @@ lib3ds_chunk_write_end(Lib3dsChunk *c, Lib3dsIo *io) {
 
 void
 lib3ds_chunk_unknown(uint16_t chunk, Lib3dsIo *io) {
-    if (io->log_func) {
+    if (lib3ds_io_log_enabled(io, LIB3DS_LOG_WARN)) {
         lib3ds_io_log(io, LIB3DS_LOG_WARN, "Unknown Chunk: %s (0x%X)", lib3ds_chunk_name(chunk), chunk);
     }
 }
@@ -0,0 +1,553 @@
+/*
+    Copyright (C) 1996-2008 by Jan Eric Kyprianidis <www.kyprianidis.com>
+    All rights reserved.
+
+    This program is free  software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation, either version 2.1 of the License, or
+    (at your option) any later version.
+
+    Thisprogram  is  distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should  have received a copy of the GNU Lesser General Public License
+    along with  this program; If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "lib3ds_impl.h"
+
+
+static void
+index_add(Lib3dsChunkIndex *index, Lib3dsChunk *c, int parent) {
+    Lib3dsChunkIndexEntry *e;
+
+    if (index->nentries >= index->entries_size) {
+        int size = index->entries_size? 2 * index->entries_size : 256;
+        index->entries = (Lib3dsChunkIndexEntry*)lib3ds_util_heap_realloc(
+            index->entries, size * sizeof(Lib3dsChunkIndexEntry));
+        index->entries_size = size;
+    }
+    e = &index->entries[index->nentries++];
+    e->chunk = c->chunk;
+    e->parent = parent;
+    e->offset = c->cur;
+    e->size = c->size;
+}
+
+
+static void
+index_scan(Lib3dsChunkIndex *index, int parent, Lib3dsIo *io) {
+    Lib3dsIoImpl *impl = (Lib3dsIoImpl*)io->impl;
+    Lib3dsChunk c;
+    uint16_t chunk;
+
+    lib3ds_chunk_read_start(&c, 0, io);
+    if (c.chunk == CHK_NAMED_OBJECT) {
+        char name[64];
+        lib3ds_io_read_string(io, name, 64);
+        lib3ds_chunk_read_tell(&c, io);
+    }
+
+    while ((chunk = lib3ds_chunk_read_next(&c, io)) != 0) {
+        int entry = index->nentries;
+        index_add(index, &impl->header, parent);
+        switch (chunk) {
+            case CHK_MDATA:
+            case CHK_KFDATA:
+            case CHK_NAMED_OBJECT:
+                lib3ds_chunk_read_reset(&c, io);
+                index_scan(index, entry, io);
+                break;
+        }
+    }
+
+    lib3ds_chunk_read_end(&c, io);
+}
+
+
+/*!
+ * Builds a table of the chunk headers of a 3ds file.
+ *
+ * Only chunk headers and object names are read, everything else is
+ * skipped, so io may be a forward-only stream. Entry 0 is the file
+ * chunk itself, parents always precede their children.
+ *
+ * \param io A Lib3dsIo object previously set up by the caller.
+ *
+ * \return The index or NULL on failure.
+ */
+Lib3dsChunkIndex*
+lib3ds_chunk_index_new(Lib3dsIo *io) {
+    Lib3dsChunkIndex *index;
+    Lib3dsIoImpl *impl;
+    Lib3dsChunk c;
+
+    index = (Lib3dsChunkIndex*)lib3ds_util_heap_calloc(sizeof(Lib3dsChunkIndex));
+    if (!index) {
+        return NULL;
+    }
+
+    lib3ds_io_setup(io);
+    impl = (Lib3dsIoImpl*)io->impl;
+    if (setjmp(impl->jmpbuf) != 0) {
+        lib3ds_io_cleanup(io);
+        lib3ds_chunk_index_free(index);
+        return NULL;
+    }
+
+    lib3ds_chunk_read(&c, io);
+    switch (c.chunk) {
+        case CHK_M3DMAGIC:
+        case CHK_MLIBMAGIC:
+        case CHK_CMAGIC:
+        case CHK_MDATA:
+            index_add(index, &impl->header, -1);
+            lib3ds_chunk_read_reset(&c, io);
+            index_scan(index, 0, io);
+            break;
+
+        default:
+            lib3ds_chunk_unknown(c.chunk, io);
+            lib3ds_io_cleanup(io);
+            lib3ds_chunk_index_free(index);
+            return NULL;
+    }
+
+    memset(impl->jmpbuf, 0, sizeof(impl->jmpbuf));
+    lib3ds_io_cleanup(io);
+    if (io->error) {
+        lib3ds_chunk_index_free(index);
+        return NULL;
+    }
+    return index;
+}
+
+
+void
+lib3ds_chunk_index_free(Lib3dsChunkIndex *index) {
+    if (!index) {
+        return;
+    }
+    lib3ds_util_heap_free(index->node_lookup);
+    lib3ds_util_heap_free(index->entries);
+    lib3ds_util_heap_free(index);
+}
+
+
+/*!
+ * Finds the next entry of a given chunk id.
+ *
+ * \param index The chunk index.
+ * \param chunk The chunk id, see Lib3dsChunkId.
+ * \param start The first entry to be examined.
+ *
+ * \return Index of the entry, -1 if there is none.
+ */
+int
+lib3ds_chunk_index_find(Lib3dsChunkIndex *index, int chunk, int start) {
+    int i;
+
+    assert(index);
+    for (i = (start > 0)? start : 0; i < index->nentries; ++i) {
+        if (index->entries[i].chunk == chunk) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+/* Returns the chunk holding the name of an entry, 0 for a name at the
+   start of the chunk data or -1 if the entry has no name. */
+static int
+name_chunk_of(uint16_t chunk) {
+    switch (chunk) {
+        case CHK_NAMED_OBJECT:
+            return 0;
+        case CHK_MAT_ENTRY:
+            return CHK_MAT_NAME;
+        case CHK_AMBIENT_NODE_TAG:
+        case CHK_OBJECT_NODE_TAG:
+        case CHK_CAMERA_NODE_TAG:
+        case CHK_TARGET_NODE_TAG:
+        case CHK_LIGHT_NODE_TAG:
+        case CHK_SPOTLIGHT_NODE_TAG:
+        case CHK_L_TARGET_NODE_TAG:
+            return CHK_NODE_HDR;
+        default:
+            return -1;
+    }
+}
+
+
+/* Reads the name of an entry, kept out of lib3ds_chunk_index_read_name
+   so no local variable is modified between setjmp and longjmp. */
+static int
+entry_name_read(Lib3dsChunkIndex *index, Lib3dsIo *io, int entry, char name[64]) {
+    int name_chunk = name_chunk_of(index->entries[entry].chunk);
+    Lib3dsChunk c;
+    uint16_t chunk;
+
+    lib3ds_io_seek(io, (long)index->entries[entry].offset, LIB3DS_SEEK_SET);
+    lib3ds_chunk_read_start(&c, 0, io);
+    if (!name_chunk) {
+        lib3ds_io_read_string(io, name, 64);
+        return TRUE;
+    }
+    while ((chunk = lib3ds_chunk_read_next(&c, io)) != 0) {
+        if (chunk == name_chunk) {
+            lib3ds_io_read_string(io, name, 64);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+
+/*!
+ * Reads the name of a named object, a material or a node.
+ *
+ * \param index The chunk index.
+ * \param io    The stream the index was built from.
+ * \param entry A NAMED_OBJECT, MAT_ENTRY or *_NODE_TAG entry.
+ * \param name  Receives the name.
+ *
+ * \return LIB3DS_TRUE if a name was found, LIB3DS_FALSE otherwise.
+ */
+int
+lib3ds_chunk_index_read_name(Lib3dsChunkIndex *index, Lib3dsIo *io, int entry, char name[64]) {
+    Lib3dsIoImpl *impl;
+    int found;
+
+    assert(index && (entry >= 0) && (entry < index->nentries));
+    name[0] = 0;
+    if (name_chunk_of(index->entries[entry].chunk) < 0) {
+        return FALSE;
+    }
+
+    lib3ds_io_setup(io);
+    impl = (Lib3dsIoImpl*)io->impl;
+    if (setjmp(impl->jmpbuf) != 0) {
+        lib3ds_io_cleanup(io);
+        return FALSE;
+    }
+
+    found = entry_name_read(index, io, entry, name);
+
+    memset(impl->jmpbuf, 0, sizeof(impl->jmpbuf));
+    lib3ds_io_cleanup(io);
+    return found && !io->error;
+}
+
+
+/*!
+ * Loads a single material.
+ *
+ * \param index The chunk index.
+ * \param io    The stream the index was built from.
+ * \param entry A MAT_ENTRY entry.
+ *
+ * \return The material or NULL on failure.
+ */
+Lib3dsMaterial*
+lib3ds_chunk_index_load_material(Lib3dsChunkIndex *index, Lib3dsIo *io, int entry) {
+    Lib3dsMaterial *material;
+    Lib3dsIoImpl *impl;
+
+    assert(index && (entry >= 0) && (entry < index->nentries));
+    if (index->entries[entry].chunk != CHK_MAT_ENTRY) {
+        return NULL;
+    }
+
+    material = lib3ds_material_new(NULL);
+    lib3ds_io_setup(io);
+    impl = (Lib3dsIoImpl*)io->impl;
+    if (setjmp(impl->jmpbuf) != 0) {
+        lib3ds_io_cleanup(io);
+        lib3ds_material_free(material);
+        return NULL;
+    }
+
+    lib3ds_io_seek(io, (long)index->entries[entry].offset, LIB3DS_SEEK_SET);
+    lib3ds_material_read(material, io);
+
+    memset(impl->jmpbuf, 0, sizeof(impl->jmpbuf));
+    lib3ds_io_cleanup(io);
+    if (io->error) {
+        lib3ds_material_free(material);
+        return NULL;
+    }
+    return material;
+}
+
+
+/*!
+ * Loads the mesh, camera or light of a named object and appends it
+ * to file. Face materials of a mesh are resolved against the materials
+ * already present in file.
+ *
+ * \param index The chunk index.
+ * \param io    The stream the index was built from.
+ * \param entry A NAMED_OBJECT entry, or one of its children.
+ * \param file  Receives the object.
+ *
+ * \return LIB3DS_TRUE on success, LIB3DS_FALSE on failure.
+ */
+int
+lib3ds_chunk_index_load_object(Lib3dsChunkIndex *index, Lib3dsIo *io, int entry, Lib3dsFile *file) {
+    Lib3dsIoImpl *impl;
+    Lib3dsArena *arena;
+
+    assert(index && (entry >= 0) && (entry < index->nentries));
+    assert(file);
+    if ((index->entries[entry].chunk != CHK_NAMED_OBJECT) && (index->entries[entry].parent >= 0)) {
+        entry = index->entries[entry].parent;
+    }
+    if (index->entries[entry].chunk != CHK_NAMED_OBJECT) {
+        return FALSE;
+    }
+
+    lib3ds_io_setup(io);
+    impl = (Lib3dsIoImpl*)io->impl;
+    arena = lib3ds_util_arena_set(file->arena);
+    if (setjmp(impl->jmpbuf) != 0) {
+        lib3ds_io_cleanup(io);
+        lib3ds_util_arena_set(arena);
+        return FALSE;
+    }
+
+    lib3ds_io_seek(io, (long)index->entries[entry].offset, LIB3DS_SEEK_SET);
+    lib3ds_file_read_named_object(file, io);
+
+    memset(impl->jmpbuf, 0, sizeof(impl->jmpbuf));
+    lib3ds_io_cleanup(io);
+    lib3ds_util_arena_set(arena);
+    return !io->error;
+}
+
+
+static int
+is_node_tag(uint16_t chunk) {
+    return (chunk >= CHK_AMBIENT_NODE_TAG) && (chunk <= CHK_SPOTLIGHT_NODE_TAG);
+}
+
+
+static Lib3dsNodeType
+node_tag_type(uint16_t chunk) {
+    switch (chunk) {
+        case CHK_AMBIENT_NODE_TAG:
+            return LIB3DS_NODE_AMBIENT_COLOR;
+        case CHK_OBJECT_NODE_TAG:
+            return LIB3DS_NODE_MESH_INSTANCE;
+        case CHK_CAMERA_NODE_TAG:
+            return LIB3DS_NODE_CAMERA;
+        case CHK_TARGET_NODE_TAG:
+            return LIB3DS_NODE_CAMERA_TARGET;
+        case CHK_LIGHT_NODE_TAG:
+            return LIB3DS_NODE_OMNILIGHT;
+        case CHK_SPOTLIGHT_NODE_TAG:
+            return LIB3DS_NODE_SPOTLIGHT;
+        default:
+            return LIB3DS_NODE_SPOTLIGHT_TARGET;
+    }
+}
+
+
+/* Reads the node id and parent id of a node chunk. */
+static void
+node_ids_read(uint16_t *node_id, uint16_t *parent_id, Lib3dsIo *io) {
+    Lib3dsChunk c;
+    uint16_t chunk;
+    char name[64];
+
+    lib3ds_chunk_read_start(&c, 0, io);
+    while ((chunk = lib3ds_chunk_read_next(&c, io)) != 0) {
+        switch (chunk) {
+            case CHK_NODE_ID:
+                *node_id = lib3ds_io_read_word(io);
+                break;
+
+            case CHK_NODE_HDR:
+                lib3ds_io_read_string(io, name, 64);
+                lib3ds_io_read_dword(io);
+                *parent_id = lib3ds_io_read_word(io);
+                break;
+        }
+    }
+    lib3ds_chunk_read_end(&c, io);
+}
+
+
+typedef struct NodeLoad {
+    int n;              /* number of node chunks in the KFDATA chunk */
+    int *entries;       /* index entry of each node chunk */
+    int *included;      /* node belongs to the loaded subtree */
+    int *lookup;        /* node chunk with a node id, -1 if none */
+    int nlookup;        /* number of ids entered into lookup */
+    uint16_t *ids;
+    uint16_t *parents;
+    Lib3dsNode **nodes;
+} NodeLoad;
+
+
+static void
+node_load_free(NodeLoad *load) {
+    int i;
+    for (i = 0; i < load->n; ++i) {
+        if (load->nodes[i]) {
+            lib3ds_node_free(load->nodes[i]);
+        }
+    }
+    /* the lookup is kept by the index, only the used entries are reset */
+    for (i = 0; i < load->nlookup; ++i) {
+        load->lookup[load->ids[i]] = -1;
+    }
+    lib3ds_util_heap_free(load->nodes);
+    lib3ds_util_heap_free(load->ids);
+    lib3ds_util_heap_free(load->entries);
+}
+
+
+/* Does the work of lib3ds_chunk_index_load_nodes between setjmp and 
+   longjmp, the nodes handed to file are removed from load->nodes. */
+static Lib3dsNode*
+nodes_load(NodeLoad *load, Lib3dsChunkIndex *index, Lib3dsIo *io, int entry, Lib3dsFile *file) {
+    int kfdata = index->entries[entry].parent;
+    int n = load->n;
+    int i, j, changed;
+    Lib3dsNode *root = NULL;
+
+    for (i = kfdata + 1, j = 0; i < index->nentries; ++i) {
+        if ((index->entries[i].parent == kfdata) && is_node_tag(index->entries[i].chunk)) {
+            load->entries[j++] = i;
+        }
+    }
+
+    /* collect the hierarchy, node ids default to the node's position
+       as in lib3ds_file_read */
+    for (j = 0; j < n; ++j) {
+        load->ids[j] = (uint16_t)j;
+        load->parents[j] = 65535;
+        lib3ds_io_seek(io, (long)index->entries[load->entries[j]].offset, LIB3DS_SEEK_SET);
+        node_ids_read(&load->ids[j], &load->parents[j], io);
+        if (load->lookup[load->ids[j]] >= 0) {
+            lib3ds_io_log(io, LIB3DS_LOG_ERROR, "Duplicate node id %d.", load->ids[j]);
+            return NULL;
+        }
+        load->lookup[load->ids[j]] = j;
+        load->nlookup = j + 1;
+        load->included[j] = (load->entries[j] == entry);
+    }
+
+    do {
+        changed = FALSE;
+        for (j = 0; j < n; ++j) {
+            int parent = (load->parents[j] != 65535)? load->lookup[load->parents[j]] : -1;
+            if (!load->included[j] && (parent >= 0) && load->included[parent]) {
+                load->included[j] = TRUE;
+                changed = TRUE;
+            }
+        }
+    } while (changed);
+
+    for (j = 0; j < n; ++j) {
+        if (load->included[j]) {
+            load->nodes[j] = lib3ds_node_new(node_tag_type(index->entries[load->entries[j]].chunk));
+            load->nodes[j]->node_id = (unsigned short)j;
+            lib3ds_io_seek(io, (long)index->entries[load->entries[j]].offset, LIB3DS_SEEK_SET);
+            lib3ds_node_read(load->nodes[j], io);
+        }
+    }
+    if (io->error) {
+        return NULL;
+    }
+
+    for (j = 0; j < n; ++j) {
+        if (load->nodes[j]) {
+            Lib3dsNode *parent = NULL;
+            if (load->entries[j] == entry) {
+                root = load->nodes[j];
+            } else {
+                parent = load->nodes[load->lookup[load->parents[j]]];
+            }
+            lib3ds_file_append_node(file, load->nodes[j], parent);
+            load->nodes[j]->user_id = 0;
+        }
+    }
+    for (j = 0; j < n; ++j) {
+        load->nodes[j] = NULL;
+    }
+    return root;
+}
+
+
+/*!
+ * Loads a node together with all of its descendants and appends it to
+ * the top level nodes of file. Only the node chunks of the enclosing
+ * KFDATA chunk are visited, the nodes outside the subtree are not
+ * decoded. Parents are found by node id, so files using a node id more
+ * than once are rejected. The node id lookup is kept by the index
+ * between calls, so calls sharing an index must not overlap.
+ *
+ * \param index The chunk index.
+ * \param io    The stream the index was built from.
+ * \param entry A *_NODE_TAG entry.
+ * \param file  Receives the nodes.
+ *
+ * \return The root of the loaded subtree or NULL on failure.
+ */
+Lib3dsNode*
+lib3ds_chunk_index_load_nodes(Lib3dsChunkIndex *index, Lib3dsIo *io, int entry, Lib3dsFile *file) {
+    Lib3dsIoImpl *impl;
+    Lib3dsArena *arena;
+    NodeLoad load;
+    Lib3dsNode *root;
+    int kfdata, i;
+
+    assert(index && (entry >= 0) && (entry < index->nentries));
+    assert(file);
+    if (!is_node_tag(index->entries[entry].chunk)) {
+        return NULL;
+    }
+
+    kfdata = index->entries[entry].parent;
+    load.n = 0;
+    for (i = kfdata + 1; i < index->nentries; ++i) {
+        if ((index->entries[i].parent == kfdata) && is_node_tag(index->entries[i].chunk)) {
+            ++load.n;
+        }
+    }
+
+    load.entries = (int*)lib3ds_util_heap_malloc(2 * load.n * sizeof(int));
+    load.included = load.entries + load.n;
+    if (!index->node_lookup) {
+        index->node_lookup = (int*)lib3ds_util_heap_malloc(65536 * sizeof(int));
+        for (i = 0; i < 65536; ++i) {
+            index->node_lookup[i] = -1;
+        }
+    }
+    load.lookup = index->node_lookup;
+    load.nlookup = 0;
+    load.ids = (uint16_t*)lib3ds_util_heap_malloc(2 * load.n * sizeof(uint16_t));
+    load.parents = load.ids + load.n;
+    load.nodes = (Lib3dsNode**)lib3ds_util_heap_calloc(load.n * sizeof(Lib3dsNode*));
+
+    lib3ds_io_setup(io);
+    impl = (Lib3dsIoImpl*)io->impl;
+    arena = lib3ds_util_arena_set(file->arena);
+    if (setjmp(impl->jmpbuf) != 0) {
+        lib3ds_io_cleanup(io);
+        lib3ds_util_arena_set(arena);
+        node_load_free(&load);
+        return NULL;
+    }
+
+    root = nodes_load(&load, index, io, entry, file);
+
+    memset(impl->jmpbuf, 0, sizeof(impl->jmpbuf));
+    lib3ds_io_cleanup(io);
+    lib3ds_util_arena_set(arena);
+    node_load_free(&load);
+    return root;
+}
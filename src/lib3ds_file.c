@@ -17,6 +17,14 @@
 */
 #include "lib3ds_impl.h"
 
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 
 static long
 fileio_seek_func(void *self, long offset, Lib3dsIoSeek origin) {
@@ -105,7 +113,7 @@ lib3ds_file_open(const char *filename) {
 
     if (!lib3ds_file_read(file, &io)) {
         fclose(f);
-        free(file);
+        lib3ds_file_free(file);
         return NULL;
     }
 
@@ -114,6 +122,81 @@ lib3ds_file_open(const char *filename) {
 }
 
 
+/*!
+ * Loads a .3DS file from disk into memory by mapping it read-only
+ * into the address space. Parsing is done directly on the mapping
+ * using the memory backend, which avoids the per-primitive stdio
+ * overhead of lib3ds_file_open. On platforms without mmap this
+ * falls back to lib3ds_file_open.
+ *
+ * \param filename  The filename of the .3DS file
+ *
+ * \return   A pointer to the Lib3dsFile structure containing the
+ *           data of the .3DS file.
+ *           If the .3DS file can not be loaded NULL is returned.
+ *
+ * \see      lib3ds_file_open
+ */
+Lib3dsFile*
+lib3ds_file_open_mmap(const char *filename) {
+#ifndef _WIN32
+    int fd;
+    struct stat st;
+    void *data;
+    Lib3dsFile *file;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    if ((fstat(fd, &st) != 0) || (st.st_size <= 0)) {
+        close(fd);
+        return NULL;
+    }
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+
+    file = lib3ds_file_new();
+    if (file && !lib3ds_file_read_memory(file, data, (size_t)st.st_size)) {
+        lib3ds_file_free(file);
+        file = NULL;
+    }
+
+    munmap(data, (size_t)st.st_size);
+    return file;
+#else
+    return lib3ds_file_open(filename);
+#endif
+}
+
+
+/*!
+ * Read 3ds file data from a block of memory into a Lib3dsFile object.
+ *
+ * \param file The Lib3dsFile object to be filled.
+ * \param data The .3DS file data, which is read in place.
+ * \param size Size of data in bytes.
+ *
+ * \return LIB3DS_TRUE on success, LIB3DS_FALSE on failure.
+ *
+ * \see lib3ds_io_init_memory
+ */
+int
+lib3ds_file_read_memory(Lib3dsFile *file, const void *data, size_t size) {
+    Lib3dsIo io;
+    Lib3dsIoMemory mem;
+
+    lib3ds_io_init_memory(&io, &mem, data, size);
+    return lib3ds_file_read(file, &io);
+}
+
+
 /*!
  * Saves a .3DS file from memory to disk.
  *
@@ -160,7 +243,7 @@ Lib3dsFile*
 lib3ds_file_new() {
     Lib3dsFile *file;
 
-    file = (Lib3dsFile*)calloc(sizeof(Lib3dsFile), 1);
+    file = (Lib3dsFile*)lib3ds_util_heap_calloc(sizeof(Lib3dsFile));
     if (!file) {
         return(0);
     }
@@ -179,26 +262,72 @@ lib3ds_file_new() {
 
 
 /*!
- * Free a Lib3dsFile object and all of its resources.
+ * Creates a new, empty Lib3dsFile object which allocates everything 
+ * read into it from large blocks owned by the file. lib3ds_file_free()
+ * then releases a few blocks instead of every material, mesh array, 
+ * node and track on its own. It still visits every object, since 
+ * arrays may have been replaced by heap memory after reading. Memory 
+ * of objects removed from the file is only released together with the
+ * file. Arrays of objects read into the file must not be reallocated
+ * or freed with the C library functions.
  *
- * \param file The Lib3dsFile object to be freed.
+ * Memory which has to be released before the file or outlive it does 
+ * not come from the blocks: geometry read by lib3ds_mesh_load() and 
+ * the materials, objects and nodes passed to the callbacks of 
+ * lib3ds_file_read_callbacks() are allocated from the heap.
+ *
+ * \param block_size Size of the blocks in bytes, 0 for the default.
+ *
+ * \return A pointer to the Lib3dsFile structure.
+ *  If the structure cannot be allocated, NULL is returned.
  */
-void
-lib3ds_file_free(Lib3dsFile* file) {
-    assert(file);
+Lib3dsFile*
+lib3ds_file_new_arena(size_t block_size) {
+    Lib3dsFile *file = lib3ds_file_new();
+    if (!file) {
+        return NULL;
+    }
+    file->arena = lib3ds_util_arena_new(block_size);
+    if (!file->arena) {
+        lib3ds_util_heap_free(file);
+        return NULL;
+    }
+    return file;
+}
+
+
+/*!
+ * Frees the materials, cameras, lights, meshes and nodes of a file.
+ */
+static void
+file_clear(Lib3dsFile *file) {
+    Lib3dsNode *p, *q;
+
     lib3ds_file_reserve_materials(file, 0, TRUE);
     lib3ds_file_reserve_cameras(file, 0, TRUE);
     lib3ds_file_reserve_lights(file, 0, TRUE);
     lib3ds_file_reserve_meshes(file, 0, TRUE);
-    {
-        Lib3dsNode *p, *q;
+    for (p = file->nodes; p; p = q) {
+        q = p->next;
+        lib3ds_node_free(p);
+    }
+    file->nodes = NULL;
+}
 
-        for (p = file->nodes; p; p = q) {
-            q = p->next;
-            lib3ds_node_free(p);
-        }
+
+/*!
+ * Free a Lib3dsFile object and all of its resources.
+ *
+ * \param file The Lib3dsFile object to be freed.
+ */
+void
+lib3ds_file_free(Lib3dsFile* file) {
+    assert(file);
+    file_clear(file);
+    if (file->arena) {
+        lib3ds_util_arena_free(file->arena);
     }
-    free(file);
+    lib3ds_util_heap_free(file);
 }
 
 
@@ -220,8 +349,297 @@ lib3ds_file_eval(Lib3dsFile *file, float t) {
 }
 
 
+#define BAKE_CHUNK 64
+
+static int
+bake_count_nodes(Lib3dsNode *first) {
+    Lib3dsNode *p;
+    int n = 0;
+    for (p = first; p; p = p->next) {
+        n += 1 + bake_count_nodes(p->childs);
+    }
+    return n;
+}
+
+
+static int
+bake_record_size(Lib3dsNode *node) {
+    switch (node->type) {
+        case LIB3DS_NODE_AMBIENT_COLOR:
+        case LIB3DS_NODE_OMNILIGHT:
+            return 16 + 3;
+        case LIB3DS_NODE_MESH_INSTANCE:
+            return 16 + 1;
+        case LIB3DS_NODE_CAMERA:
+            return 16 + 2;
+        case LIB3DS_NODE_SPOTLIGHT:
+            return 16 + 6;
+        default:
+            return 16;
+    }
+}
+
+
+/* The tracks are compiled before the frames are evaluated in parallel,
+   so the segments are not computed again for every frame. */
+static void
+bake_compile_tracks(Lib3dsNode *node) {
+    switch (node->type) {
+        case LIB3DS_NODE_AMBIENT_COLOR: {
+            Lib3dsAmbientColorNode *n = (Lib3dsAmbientColorNode*)node;
+            lib3ds_track_compile(&n->color_track);
+            break;
+        }
+        case LIB3DS_NODE_MESH_INSTANCE: {
+            Lib3dsMeshInstanceNode *n = (Lib3dsMeshInstanceNode*)node;
+            lib3ds_track_compile(&n->pos_track);
+            lib3ds_track_compile(&n->rot_track);
+            lib3ds_track_compile(&n->scl_track);
+            break;
+        }
+        case LIB3DS_NODE_CAMERA: {
+            Lib3dsCameraNode *n = (Lib3dsCameraNode*)node;
+            lib3ds_track_compile(&n->pos_track);
+            lib3ds_track_compile(&n->fov_track);
+            lib3ds_track_compile(&n->roll_track);
+            break;
+        }
+        case LIB3DS_NODE_CAMERA_TARGET:
+        case LIB3DS_NODE_SPOTLIGHT_TARGET: {
+            Lib3dsTargetNode *n = (Lib3dsTargetNode*)node;
+            lib3ds_track_compile(&n->pos_track);
+            break;
+        }
+        case LIB3DS_NODE_OMNILIGHT: {
+            Lib3dsOmnilightNode *n = (Lib3dsOmnilightNode*)node;
+            lib3ds_track_compile(&n->pos_track);
+            lib3ds_track_compile(&n->color_track);
+            break;
+        }
+        case LIB3DS_NODE_SPOTLIGHT: {
+            Lib3dsSpotlightNode *n = (Lib3dsSpotlightNode*)node;
+            lib3ds_track_compile(&n->pos_track);
+            lib3ds_track_compile(&n->color_track);
+            lib3ds_track_compile(&n->hotspot_track);
+            lib3ds_track_compile(&n->falloff_track);
+            lib3ds_track_compile(&n->roll_track);
+            break;
+        }
+    }
+}
+
+
+static void
+bake_add_nodes(Lib3dsBake *bake, Lib3dsNode *first, int parent) {
+    Lib3dsNode *p;
+    for (p = first; p; p = p->next) {
+        Lib3dsBakeNode *b = &bake->nodes[bake->nnodes];
+        b->node = p;
+        b->parent = parent;
+        b->offset = bake->stride;
+        b->size = bake_record_size(p);
+        bake->stride += b->size;
+        bake_compile_tracks(p);
+        bake_add_nodes(bake, p->childs, bake->nnodes++);
+    }
+}
+
+
+/* The parent matrix, or the identity for root nodes, translated by pos 
+   if not NULL. */
 static void
-named_object_read(Lib3dsFile *file, Lib3dsIo *io) {
+bake_matrix(float *m, float *parent, float *pos) {
+    if (parent) {
+        lib3ds_matrix_copy((float(*)[4])m, (float(*)[4])parent);
+    } else {
+        lib3ds_matrix_identity((float(*)[4])m);
+    }
+    if (pos) {
+        lib3ds_matrix_translate((float(*)[4])m, pos[0], pos[1], pos[2]);
+    }
+}
+
+
+static void
+bake_frames(void *self, int index) {
+    Lib3dsBake *bake = (Lib3dsBake*)self;
+    float times[BAKE_CHUNK];
+    float pos[BAKE_CHUNK][3], vec[BAKE_CHUNK][3], rot[BAKE_CHUNK][4];
+    float f0[BAKE_CHUNK], f1[BAKE_CHUNK], f2[BAKE_CHUNK];
+    int hide[BAKE_CHUNK];
+    int first = index * BAKE_CHUNK;
+    int count = (bake->nframes - first < BAKE_CHUNK)? bake->nframes - first : BAKE_CHUNK;
+    size_t stride = bake->stride;
+    float *frame = bake->data + first * stride;
+    int i, k;
+
+    for (k = 0; k < count; ++k) {
+        times[k] = bake->from + (float)(first + k) * bake->step;
+    }
+
+    /* parents come before their children in bake->nodes */
+    for (i = 0; i < bake->nnodes; ++i) {
+        Lib3dsNode *node = bake->nodes[i].node;
+        float *out = frame + bake->nodes[i].offset;
+        float *parent = NULL;
+        float *m, *pm;
+
+        if (bake->nodes[i].parent >= 0) {
+            parent = frame + bake->nodes[bake->nodes[i].parent].offset;
+        }
+
+        switch (node->type) {
+            case LIB3DS_NODE_AMBIENT_COLOR: {
+                Lib3dsAmbientColorNode *n = (Lib3dsAmbientColorNode*)node;
+                lib3ds_track_eval_vector_batch(&n->color_track, times, count, vec);
+                for (k = 0; k < count; ++k) {
+                    m = out + k * stride;
+                    bake_matrix(m, parent? parent + k * stride : NULL, NULL);
+                    lib3ds_vector_copy(m + 16, vec[k]);
+                }
+                break;
+            }
+
+            case LIB3DS_NODE_MESH_INSTANCE: {
+                Lib3dsMeshInstanceNode *n = (Lib3dsMeshInstanceNode*)node;
+                float M[4][4];
+
+                lib3ds_track_eval_vector_batch(&n->pos_track, times, count, pos);
+                lib3ds_track_eval_quat_batch(&n->rot_track, times, count, rot);
+                if (n->scl_track.nkeys) {
+                    lib3ds_track_eval_vector_batch(&n->scl_track, times, count, vec);
+                } else {
+                    for (k = 0; k < count; ++k) vec[k][0] = vec[k][1] = vec[k][2] = 1.0f;
+                }
+                lib3ds_track_eval_bool_batch(&n->hide_track, times, count, hide);
+
+                for (k = 0; k < count; ++k) {
+                    lib3ds_matrix_identity(M);
+                    lib3ds_matrix_translate(M, pos[k][0], pos[k][1], pos[k][2]);
+                    lib3ds_matrix_rotate_quat(M, rot[k]);
+                    lib3ds_matrix_scale(M, vec[k][0], vec[k][1], vec[k][2]);
+
+                    m = out + k * stride;
+                    if (parent) {
+                        pm = parent + k * stride;
+                        lib3ds_matrix_mult((float(*)[4])m, (float(*)[4])pm, M);
+                    } else {
+                        lib3ds_matrix_copy((float(*)[4])m, M);
+                    }
+                    m[16] = (float)hide[k];
+                }
+                break;
+            }
+
+            case LIB3DS_NODE_CAMERA: {
+                Lib3dsCameraNode *n = (Lib3dsCameraNode*)node;
+                lib3ds_track_eval_vector_batch(&n->pos_track, times, count, pos);
+                lib3ds_track_eval_float_batch(&n->fov_track, times, count, f0);
+                lib3ds_track_eval_float_batch(&n->roll_track, times, count, f1);
+                for (k = 0; k < count; ++k) {
+                    m = out + k * stride;
+                    bake_matrix(m, parent? parent + k * stride : NULL, pos[k]);
+                    m[16] = f0[k];
+                    m[17] = f1[k];
+                }
+                break;
+            }
+
+            case LIB3DS_NODE_CAMERA_TARGET:
+            case LIB3DS_NODE_SPOTLIGHT_TARGET: {
+                Lib3dsTargetNode *n = (Lib3dsTargetNode*)node;
+                lib3ds_track_eval_vector_batch(&n->pos_track, times, count, pos);
+                for (k = 0; k < count; ++k) {
+                    m = out + k * stride;
+                    bake_matrix(m, parent? parent + k * stride : NULL, pos[k]);
+                }
+                break;
+            }
+
+            case LIB3DS_NODE_OMNILIGHT: {
+                Lib3dsOmnilightNode *n = (Lib3dsOmnilightNode*)node;
+                lib3ds_track_eval_vector_batch(&n->pos_track, times, count, pos);
+                lib3ds_track_eval_vector_batch(&n->color_track, times, count, vec);
+                for (k = 0; k < count; ++k) {
+                    m = out + k * stride;
+                    bake_matrix(m, parent? parent + k * stride : NULL, pos[k]);
+                    lib3ds_vector_copy(m + 16, vec[k]);
+                }
+                break;
+            }
+
+            case LIB3DS_NODE_SPOTLIGHT: {
+                Lib3dsSpotlightNode *n = (Lib3dsSpotlightNode*)node;
+                lib3ds_track_eval_vector_batch(&n->pos_track, times, count, pos);
+                lib3ds_track_eval_vector_batch(&n->color_track, times, count, vec);
+                lib3ds_track_eval_float_batch(&n->hotspot_track, times, count, f0);
+                lib3ds_track_eval_float_batch(&n->falloff_track, times, count, f1);
+                lib3ds_track_eval_float_batch(&n->roll_track, times, count, f2);
+                for (k = 0; k < count; ++k) {
+                    m = out + k * stride;
+                    bake_matrix(m, parent? parent + k * stride : NULL, pos[k]);
+                    lib3ds_vector_copy(m + 16, vec[k]);
+                    m[19] = f0[k];
+                    m[20] = f1[k];
+                    m[21] = f2[k];
+                }
+                break;
+            }
+        }
+    }
+}
+
+
+/*!
+ * Samples the node hierarchy of a file over a range of frames. For 
+ * every frame the world matrix of every node and its animated values 
+ * are computed as by lib3ds_file_eval() and stored in one frame-major
+ * buffer, see Lib3dsBake for the layout. The frames are evaluated in
+ * parallel.
+ *
+ * \param file      The file.
+ * \param from      Time of the first frame.
+ * \param to        Time of the last frame.
+ * \param step      Time between two frames, greater than 0.
+ * \param nthreads  Number of threads, 0 to use all processors.
+ *
+ * \return The sampled values, to be freed with lib3ds_file_bake_free(), 
+ *         or NULL if the range is empty.
+ */
+Lib3dsBake*
+lib3ds_file_bake(Lib3dsFile *file, float from, float to, float step, int nthreads) {
+    Lib3dsBake *bake;
+
+    assert(file);
+    if (!(step > 0) || (to < from)) {
+        return NULL;
+    }
+
+    bake = (Lib3dsBake*)lib3ds_util_heap_calloc(sizeof(Lib3dsBake));
+    bake->from = from;
+    bake->step = step;
+    bake->nframes = (int)((to - from) / step + 1e-3f) + 1;
+    bake->nodes = (Lib3dsBakeNode*)lib3ds_util_heap_malloc(sizeof(Lib3dsBakeNode) * bake_count_nodes(file->nodes));
+    bake_add_nodes(bake, file->nodes, -1);
+    bake->data = (float*)lib3ds_util_heap_malloc(sizeof(float) * (size_t)bake->nframes * bake->stride);
+
+    lib3ds_util_parallel_for((bake->nframes + BAKE_CHUNK - 1) / BAKE_CHUNK, nthreads, bake_frames, bake);
+    return bake;
+}
+
+
+void
+lib3ds_file_bake_free(Lib3dsBake *bake) {
+    if (bake) {
+        lib3ds_util_heap_free(bake->nodes);
+        lib3ds_util_heap_free(bake->data);
+        lib3ds_util_heap_free(bake);
+    }
+}
+
+
+void
+lib3ds_file_read_named_object(Lib3dsFile *file, Lib3dsIo *io) {
     Lib3dsChunk c;
     char name[64];
     uint16_t chunk;
@@ -229,8 +647,17 @@ named_object_read(Lib3dsFile *file, Lib3dsIo *io) {
     Lib3dsCamera *camera = NULL;
     Lib3dsLight *light = NULL;
     uint32_t object_flags;
+    Lib3dsReadCallbacks *callbacks = ((Lib3dsIoImpl*)io->impl)->callbacks;
+    Lib3dsArena *arena = NULL;
+    int heap;
 
     lib3ds_chunk_read_start(&c, CHK_NAMED_OBJECT, io);
+
+    /* objects handed to the callbacks must not live in the arena of file */
+    heap = callbacks && (callbacks->mesh_func || callbacks->camera_func || callbacks->light_func);
+    if (heap) {
+        arena = lib3ds_util_arena_set(NULL);
+    }
     
     lib3ds_io_read_string(io, name, 64);
     lib3ds_io_log(io, LIB3DS_LOG_INFO, "  NAME=%s", name);
@@ -304,6 +731,28 @@ named_object_read(Lib3dsFile *file, Lib3dsIo *io) {
         light->object_flags = object_flags;
 
     lib3ds_chunk_read_end(&c, io);
+
+    if (callbacks && !io->error) {
+        /* the objects were appended last, hand them over or free them */
+        if (mesh && callbacks->mesh_func) {
+            int owned = (*callbacks->mesh_func)(callbacks->self, mesh);
+            lib3ds_util_remove_array((void***)&file->meshes, &file->nmeshes, file->nmeshes - 1, 
+                                     owned? NULL : (Lib3dsFreeFunc)lib3ds_mesh_free);
+        }
+        if (camera && callbacks->camera_func) {
+            int owned = (*callbacks->camera_func)(callbacks->self, camera);
+            lib3ds_util_remove_array((void***)&file->cameras, &file->ncameras, file->ncameras - 1, 
+                                     owned? NULL : (Lib3dsFreeFunc)lib3ds_camera_free);
+        }
+        if (light && callbacks->light_func) {
+            int owned = (*callbacks->light_func)(callbacks->self, light);
+            lib3ds_util_remove_array((void***)&file->lights, &file->nlights, file->nlights - 1, 
+                                     owned? NULL : (Lib3dsFreeFunc)lib3ds_light_free);
+        }
+    }
+    if (heap) {
+        lib3ds_util_arena_set(arena);
+    }
 }
 
 
@@ -422,16 +871,40 @@ mdata_read(Lib3dsFile *file, Lib3dsIo *io) {
             }
 
             case CHK_MAT_ENTRY: {
-                Lib3dsMaterial *material = lib3ds_material_new(NULL);
+                Lib3dsMaterial *material;
+                Lib3dsReadCallbacks *callbacks = ((Lib3dsIoImpl*)io->impl)->callbacks;
+                Lib3dsArena *arena = NULL;
+                if (((Lib3dsIoImpl*)io->impl)->skip_objects) {
+                    break;
+                }
+                if (callbacks && callbacks->material_func) {
+                    arena = lib3ds_util_arena_set(NULL);
+                }
+                material = lib3ds_material_new(NULL);
                 lib3ds_file_insert_material(file, material, -1);
                 lib3ds_chunk_read_reset(&c, io);
                 lib3ds_material_read(material, io);
+                if (callbacks && callbacks->material_func) {
+                    lib3ds_util_arena_set(arena);
+                }
+                if (callbacks && callbacks->material_func && !io->error) {
+                    /* face materials are resolved by name, so the file
+                       keeps a placeholder if the material is taken */
+                    char name[64];
+                    strcpy(name, material->name);
+                    if ((*callbacks->material_func)(callbacks->self, material)) {
+                        file->materials[file->nmaterials - 1] = lib3ds_material_new(name);
+                    }
+                }
                 break;
             }
 
             case CHK_NAMED_OBJECT: {
+                if (((Lib3dsIoImpl*)io->impl)->skip_objects) {
+                    break;
+                }
                 lib3ds_chunk_read_reset(&c, io);
-                named_object_read(file, io);
+                lib3ds_file_read_named_object(file, io);
                 break;
             }
 
@@ -462,6 +935,8 @@ kfdata_read(Lib3dsFile *file, Lib3dsIo *io) {
     uint16_t chunk;
     unsigned num_nodes = 0;
     Lib3dsNode *last = NULL;
+    Lib3dsIoImpl *impl = (Lib3dsIoImpl*)io->impl;
+    Lib3dsReadCallbacks *callbacks = impl->callbacks;
 
     lib3ds_chunk_read_start(&c, CHK_KFDATA, io);
 
@@ -526,6 +1001,23 @@ kfdata_read(Lib3dsFile *file, Lib3dsIo *io) {
                         break;
                 }
 
+                if (callbacks && callbacks->node_func) {
+                    Lib3dsArena *arena = lib3ds_util_arena_set(NULL);
+                    unsigned short parent_id;
+                    node = lib3ds_node_new(type);
+                    node->node_id = (unsigned short)(num_nodes++);
+                    impl->tmp_node = node;
+                    lib3ds_chunk_read_reset(&c, io);
+                    lib3ds_node_read(node, io);
+                    impl->tmp_node = NULL;
+                    lib3ds_util_arena_set(arena);
+                    parent_id = (unsigned short)node->user_id;
+                    node->user_id = 0;
+                    if (io->error || !(*callbacks->node_func)(callbacks->self, node, parent_id)) {
+                        lib3ds_node_free(node);
+                    }
+                    break;
+                }
                 node = lib3ds_node_new(type);
                 node->node_id = (unsigned short)(num_nodes++);
                 if (last) {
@@ -545,10 +1037,10 @@ kfdata_read(Lib3dsFile *file, Lib3dsIo *io) {
         }
     }
 
-    {
-        Lib3dsNode **nodes = (Lib3dsNode**)malloc(num_nodes * sizeof(Lib3dsNode*));
+    if (last) {
+        Lib3dsNode **nodes = (Lib3dsNode**)lib3ds_util_heap_malloc(num_nodes * sizeof(Lib3dsNode*));
         unsigned i;
-        Lib3dsNode *p, *q, *parent;
+        Lib3dsNode *p, *q, *parent, **pp;
 
         p = file->nodes;
         for (i = 0; i < num_nodes; ++i) {
@@ -561,7 +1053,8 @@ kfdata_read(Lib3dsFile *file, Lib3dsIo *io) {
         while (p) {
             q = (Lib3dsNode*)p->user_ptr;
             if (p->user_id != 65535) {
-                parent = *(Lib3dsNode**)bsearch(&p->user_id, nodes, num_nodes, sizeof(Lib3dsNode*), compare_node_id2);
+                pp = (Lib3dsNode**)bsearch(&p->user_id, nodes, num_nodes, sizeof(Lib3dsNode*), compare_node_id2);
+                parent = pp? *pp : NULL;
                 if (parent) {
                     q->next = p->next;    
                     p->next = parent->childs;
@@ -575,32 +1068,105 @@ kfdata_read(Lib3dsFile *file, Lib3dsIo *io) {
             p->user_ptr = NULL;
             p = q;
         }
-        free(nodes);
+        lib3ds_util_heap_free(nodes);
     }
 
     lib3ds_chunk_read_end(&c, io);
 }
 
 
-/*!
- * Read 3ds file data into a Lib3dsFile object.
- *
- * \param file The Lib3dsFile object to be filled.
- * \param io A Lib3dsIo object previously set up by the caller.
- *
- * \return LIB3DS_TRUE on success, LIB3DS_FALSE on failure.
- */
-int
-lib3ds_file_read(Lib3dsFile *file, Lib3dsIo *io) {
+static int
+mesh_loaded(Lib3dsMesh *mesh) {
+    return (!mesh->nvertices || mesh->vertices) && (!mesh->nfaces || mesh->faces);
+}
+
+
+/* Appends the geometry of part to mesh, the material and smoothing
+   information of the faces is kept. */
+static void
+mesh_append(Lib3dsMesh *mesh, Lib3dsMesh *part) {
+    int nvertices = mesh->nvertices;
+    int nfaces = mesh->nfaces;
+    int i, j;
+
+    lib3ds_mesh_resize_vertices(
+        mesh, 
+        nvertices + part->nvertices, 
+        mesh->texcos || part->texcos, 
+        mesh->vflags || part->vflags
+    );
+    for (i = 0; i < part->nvertices; ++i) {
+        lib3ds_vector_copy(mesh->vertices[nvertices + i], part->vertices[i]);
+        if (part->texcos) {
+            mesh->texcos[nvertices + i][0] = part->texcos[i][0];
+            mesh->texcos[nvertices + i][1] = part->texcos[i][1];
+        }
+        if (part->vflags) {
+            mesh->vflags[nvertices + i] = part->vflags[i];
+        }
+    }
+    lib3ds_mesh_resize_faces(mesh, nfaces + part->nfaces);
+    for (i = 0; i < part->nfaces; ++i) {
+        mesh->faces[nfaces + i] = part->faces[i];
+        for (j = 0; j < 3; ++j) {
+            mesh->faces[nfaces + i].index[j] += nvertices;
+        }
+    }
+}
+
+
+/* Joins meshes written as parts "name", "name#1", "name#2", ... by 
+   lib3ds_file_write() back into a single mesh (LIB3DS_IO_MERGE_MESHES),
+   the nodes written for the parts are removed. Meshes whose data has 
+   not been loaded (LIB3DS_IO_LAZY_MESHES) are skipped. */
+static void
+merge_meshes(Lib3dsFile *file) {
+    Lib3dsArena *arena = lib3ds_util_arena_set(file->arena);
+    int i;
+
+    for (i = 0; i < file->nmeshes; ++i) {
+        Lib3dsMesh *mesh = file->meshes[i];
+        Lib3dsNode *node;
+        int part = 1;
+        if (!mesh_loaded(mesh)) {
+            continue;
+        }
+        while (i + 1 < file->nmeshes) {
+            char name[64];
+            lib3ds_mesh_part_name(name, mesh->name, part);
+            if ((strcmp(file->meshes[i + 1]->name, name) != 0) || !mesh_loaded(file->meshes[i + 1])) {
+                break;
+            }
+            mesh_append(mesh, file->meshes[i + 1]);
+            lib3ds_file_remove_mesh(file, i + 1);
+            while ((node = lib3ds_file_node_by_name(file, name, LIB3DS_NODE_MESH_INSTANCE)) != NULL) {
+                lib3ds_file_remove_node(file, node);
+                lib3ds_node_free(node);
+            }
+            ++part;
+        }
+    }
+    lib3ds_util_arena_set(arena);
+}
+
+
+static int
+file_read(Lib3dsFile *file, Lib3dsIo *io, Lib3dsReadCallbacks *callbacks, int skip_objects) {
     Lib3dsChunk c;
     uint16_t chunk;
     Lib3dsIoImpl *impl;
+    Lib3dsArena *arena;
 
     lib3ds_io_setup(io);
     impl = (Lib3dsIoImpl*)io->impl;
+    impl->callbacks = callbacks;
+    impl->skip_objects = skip_objects;
+    arena = lib3ds_util_arena_set(file->arena);
 
     if (setjmp(impl->jmpbuf) != 0) {
         lib3ds_io_cleanup(io);
+        file_clear(file);
+        lib3ds_util_arena_set(arena);
         return FALSE;
     }
 
@@ -643,6 +1209,8 @@ lib3ds_file_read(Lib3dsFile *file, Lib3dsIo *io) {
 
         default:
             lib3ds_chunk_unknown(c.chunk, io);
+            lib3ds_io_cleanup(io);
+            lib3ds_util_arena_set(arena);
             return FALSE;
     }
 
@@ -650,10 +1218,268 @@ lib3ds_file_read(Lib3dsFile *file, Lib3dsIo *io) {
 
     memset(impl->jmpbuf, 0, sizeof(impl->jmpbuf));
     lib3ds_io_cleanup(io);
+    lib3ds_util_arena_set(arena);
+    if (io->error) {
+        /* LIB3DS_IO_STICKY_ERRORS, the readers unwound without longjmp */
+        file_clear(file);
+        return FALSE;
+    }
+    if ((io->flags & LIB3DS_IO_MERGE_MESHES) && !skip_objects) {
+        merge_meshes(file);
+    }
     return TRUE;
 }
 
 
+/*!
+ * Read 3ds file data into a Lib3dsFile object.
+ *
+ * The file is parsed in a single forward pass, so io does not need 
+ * seek_func or tell_func (e.g. when reading from a pipe). Unknown or
+ * partially read chunks are skipped by reading past them.
+ *
+ * \param file The Lib3dsFile object to be filled.
+ * \param io A Lib3dsIo object previously set up by the caller.
+ *
+ * \return LIB3DS_TRUE on success, LIB3DS_FALSE on failure.
+ */
+int
+lib3ds_file_read(Lib3dsFile *file, Lib3dsIo *io) {
+    return lib3ds_file_read_callbacks(file, io, NULL);
+}
+
+
+/*!
+ * Read 3ds file data and pass the materials, objects and nodes to 
+ * callbacks as soon as each of them is decoded.
+ *
+ * Objects and nodes handed to a callback are removed from the file 
+ * again, so memory use is bound by the largest object instead of the 
+ * whole file. Nodes are passed unlinked with the id of their parent 
+ * node (65535 for top level nodes). Materials stay in the file since 
+ * face materials are resolved by name, a material taken by the callback
+ * is replaced by a placeholder carrying its name. Everything else is 
+ * read into file as by lib3ds_file_read().
+ *
+ * \param file The Lib3dsFile object to be filled.
+ * \param io A Lib3dsIo object previously set up by the caller.
+ * \param callbacks The callbacks, may be NULL.
+ *
+ * \return LIB3DS_TRUE on success, LIB3DS_FALSE on failure.
+ */
+int
+lib3ds_file_read_callbacks(Lib3dsFile *file, Lib3dsIo *io, Lib3dsReadCallbacks *callbacks) {
+    return file_read(file, io, callbacks, FALSE);
+}
+
+
+typedef struct ParallelRead {
+    Lib3dsFile *file;
+    Lib3dsIo *io;
+    Lib3dsIoMemory *mem;
+    Lib3dsChunkIndex *index;
+    int *entries;
+    int *nmaterials;    /* materials preceding each entry */
+    void **results;
+} ParallelRead;
+
+
+static void
+parallel_io_init(ParallelRead *p, Lib3dsIo *io, Lib3dsIoMemory *mem) {
+    lib3ds_io_init_memory(io, mem, p->mem->data, p->mem->size);
+    io->log_func = p->io->log_func;
+    io->flags = p->io->flags;
+    io->log_level = p->io->log_level;
+    io->log_chunk_func = p->io->log_chunk_func;
+}
+
+
+static void
+parallel_material_read(void *self, int i) {
+    ParallelRead *p = (ParallelRead*)self;
+    Lib3dsIo io;
+    Lib3dsIoMemory mem;
+    Lib3dsIoImpl *impl;
+    Lib3dsMaterial *material = lib3ds_material_new(NULL);
+
+    parallel_io_init(p, &io, &mem);
+    lib3ds_io_setup(&io);
+    impl = (Lib3dsIoImpl*)io.impl;
+    if (setjmp(impl->jmpbuf) != 0) {
+        lib3ds_io_cleanup(&io);
+        lib3ds_material_free(material);
+        return;
+    }
+
+    lib3ds_io_seek(&io, (long)p->index->entries[p->entries[i]].offset, LIB3DS_SEEK_SET);
+    lib3ds_material_read(material, &io);
+
+    memset(impl->jmpbuf, 0, sizeof(impl->jmpbuf));
+    lib3ds_io_cleanup(&io);
+    if (io.error) {
+        lib3ds_material_free(material);
+        return;
+    }
+    p->results[i] = material;
+}
+
+
+/* Each named object is read into a file of its own, which shares the
+   materials preceding the object with the target file for face material 
+   lookups, just like a serial read. */
+static void
+parallel_named_object_read(void *self, int i) {
+    ParallelRead *p = (ParallelRead*)self;
+    Lib3dsIo io;
+    Lib3dsIoMemory mem;
+    Lib3dsIoImpl *impl;
+    Lib3dsFile *file = lib3ds_file_new();
+
+    file->materials = p->file->materials;
+    file->nmaterials = p->nmaterials[i];
+    file->materials_size = p->file->materials_size;
+
+    parallel_io_init(p, &io, &mem);
+    lib3ds_io_setup(&io);
+    impl = (Lib3dsIoImpl*)io.impl;
+    if (setjmp(impl->jmpbuf) != 0) {
+        lib3ds_io_cleanup(&io);
+        file->materials = NULL;
+        file->nmaterials = file->materials_size = 0;
+        lib3ds_file_free(file);
+        return;
+    }
+
+    lib3ds_io_seek(&io, (long)p->index->entries[p->entries[i]].offset, LIB3DS_SEEK_SET);
+    lib3ds_file_read_named_object(file, &io);
+
+    memset(impl->jmpbuf, 0, sizeof(impl->jmpbuf));
+    lib3ds_io_cleanup(&io);
+    file->materials = NULL;
+    file->nmaterials = file->materials_size = 0;
+    if (io.error) {
+        lib3ds_file_free(file);
+        return;
+    }
+    p->results[i] = file;
+}
+
+
+static int
+parallel_collect(ParallelRead *p, uint16_t chunk) {
+    int i, n = 0, nmaterials = 0;
+    for (i = 0; i < p->index->nentries; ++i) {
+        Lib3dsChunkIndexEntry *e = &p->index->entries[i];
+        if ((e->parent < 0) || (p->index->entries[e->parent].chunk != CHK_MDATA)) {
+            continue;
+        }
+        if (e->chunk == chunk) {
+            p->entries[n] = i;
+            p->nmaterials[n] = nmaterials;
+            p->results[n] = NULL;
+            ++n;
+        }
+        if (e->chunk == CHK_MAT_ENTRY) {
+            ++nmaterials;
+        }
+    }
+    return n;
+}
+
+
+/*!
+ * Read 3ds file data into a Lib3dsFile object, decoding materials and
+ * named objects on multiple threads.
+ *
+ * Requires io to be set up by lib3ds_io_init_memory(), otherwise or
+ * with a single thread the file is read by lib3ds_file_read(). After a serial pass for 
+ * everything else, the materials and then the named objects are 
+ * decoded concurrently and appended in file order, so the result is 
+ * the same as with lib3ds_file_read(). The log function of io may be 
+ * called from several threads at once. Materials and objects decoded 
+ * by the worker threads are allocated from the heap, even if file was
+ * created by lib3ds_file_new_arena().
+ *
+ * \param file The Lib3dsFile object to be filled.
+ * \param io A memory stream set up by lib3ds_io_init_memory().
+ * \param nthreads Number of threads, 0 to use all processors.
+ *
+ * \return LIB3DS_TRUE on success, LIB3DS_FALSE on failure.
+ */
+int
+lib3ds_file_read_parallel(Lib3dsFile *file, Lib3dsIo *io, int nthreads) {
+    ParallelRead p;
+    int i, n, result = TRUE;
+
+    memset(&p, 0, sizeof(p));
+    p.file = file;
+    p.io = io;
+    p.mem = lib3ds_io_memory(io);
+    if (nthreads <= 0) {
+        nthreads = lib3ds_util_num_cpus();
+    }
+    if (!p.mem || (nthreads == 1)) {
+        return lib3ds_file_read(file, io);
+    }
+    if (!file_read(file, io, NULL, TRUE)) {
+        return FALSE;
+    }
+    lib3ds_io_seek(io, 0, LIB3DS_SEEK_SET);
+    p.index = lib3ds_chunk_index_new(io);
+    if (!p.index) {
+        file_clear(file);
+        return FALSE;
+    }
+    p.entries = (int*)lib3ds_util_heap_malloc(2 * p.index->nentries * sizeof(int));
+    p.nmaterials = p.entries + p.index->nentries;
+    p.results = (void**)lib3ds_util_heap_malloc(p.index->nentries * sizeof(void*));
+
+    n = parallel_collect(&p, CHK_MAT_ENTRY);
+    lib3ds_util_parallel_for(n, nthreads, parallel_material_read, &p);
+    lib3ds_file_reserve_materials(file, file->nmaterials + n, FALSE);
+    for (i = 0; i < n; ++i) {
+        if (p.results[i]) {
+            lib3ds_file_insert_material(file, (Lib3dsMaterial*)p.results[i], -1);
+        } else {
+            result = FALSE;
+        }
+    }
+
+    n = result? parallel_collect(&p, CHK_NAMED_OBJECT) : 0;
+    lib3ds_util_parallel_for(n, nthreads, parallel_named_object_read, &p);
+    for (i = 0; i < n; ++i) {
+        Lib3dsFile *f = (Lib3dsFile*)p.results[i];
+        int j;
+        if (!f) {
+            result = FALSE;
+            continue;
+        }
+        for (j = 0; j < f->nmeshes; ++j) {
+            lib3ds_file_insert_mesh(file, f->meshes[j], -1);
+        }
+        for (j = 0; j < f->ncameras; ++j) {
+            lib3ds_file_insert_camera(file, f->cameras[j], -1);
+        }
+        for (j = 0; j < f->nlights; ++j) {
+            lib3ds_file_insert_light(file, f->lights[j], -1);
+        }
+        f->nmeshes = f->ncameras = f->nlights = 0;
+        lib3ds_file_free(f);
+    }
+
+    lib3ds_util_heap_free(p.results);
+    lib3ds_util_heap_free(p.entries);
+    lib3ds_chunk_index_free(p.index);
+    if (!result) {
+        io->error = TRUE;
+        file_clear(file);
+    } else if (io->flags & LIB3DS_IO_MERGE_MESHES) {
+        merge_meshes(file);
+    }
+    return result;
+}
+
+
 static void
 colorf_write(float rgb[3], Lib3dsIo *io) {
     Lib3dsChunk c;
@@ -708,6 +1534,19 @@ object_flags_write(uint32_t flags, Lib3dsIo *io) {
 }
 
 
+static void
+named_mesh_write(Lib3dsFile *file, Lib3dsMesh *mesh, Lib3dsIo *io) {
+    Lib3dsChunk c;
+
+    c.chunk = CHK_NAMED_OBJECT;
+    lib3ds_chunk_write_start(&c, io);
+    lib3ds_io_write_string(io, mesh->name);
+    lib3ds_mesh_write(file, mesh, io);
+    object_flags_write(mesh->object_flags, io);
+    lib3ds_chunk_write_end(&c, io);
+}
+
+
 static void
 mdata_write(Lib3dsFile *file, Lib3dsIo *io) {
     Lib3dsChunk c;
@@ -797,16 +1636,24 @@ mdata_write(Lib3dsFile *file, Lib3dsIo *io) {
         }
     }
     {
-        Lib3dsChunk c;
         int i;
 
         for (i = 0; i < file->nmeshes; ++i) {
-            c.chunk = CHK_NAMED_OBJECT;
-            lib3ds_chunk_write_start(&c, io);
-            lib3ds_io_write_string(io, file->meshes[i]->name);
-            lib3ds_mesh_write(file, file->meshes[i], io);
-            object_flags_write(file->meshes[i]->object_flags, io);
-            lib3ds_chunk_write_end(&c, io);
+            Lib3dsMesh *mesh = file->meshes[i];
+            if (mesh_loaded(mesh) && 
+                ((mesh->nvertices > LIB3DS_MESH_MAX_SIZE) || (mesh->nfaces > LIB3DS_MESH_MAX_SIZE))) {
+                /* written as several objects, LIB3DS_IO_MERGE_MESHES joins them again */
+                Lib3dsIoImpl *impl = (Lib3dsIoImpl*)io->impl;
+                Lib3dsMesh *part;
+                impl->tmp_split = lib3ds_mesh_split_new(mesh);
+                while ((part = lib3ds_mesh_split_next(impl->tmp_split)) != NULL) {
+                    named_mesh_write(file, part, io);
+                }
+                lib3ds_mesh_split_free(impl->tmp_split);
+                impl->tmp_split = NULL;
+            } else {
+                named_mesh_write(file, mesh, io);
+            }
         }
     }
 
@@ -815,8 +1662,55 @@ mdata_write(Lib3dsFile *file, Lib3dsIo *io) {
 
 
 
+/* Returns the number of nodes and the largest node id set. */
+static int
+nodes_count(Lib3dsNode *first_node, int *max_id) {
+    Lib3dsNode *p;
+    int n = 0;
+    for (p = first_node; p != NULL; p = p->next) {
+        if ((p->node_id != 65535) && (p->node_id > *max_id)) {
+            *max_id = p->node_id;
+        }
+        n += 1 + nodes_count(p->childs, max_id);
+    }
+    return n;
+}
+
+
+/* Writes a copy of the node of a mesh mdata_write() splits into several
+   objects for each part after the first one, so the other parts are 
+   animated the same way. */
 static void
-nodes_write(Lib3dsNode *first_node, uint16_t *default_id, uint16_t parent_id, Lib3dsIo *io) {
+split_nodes_write(Lib3dsFile *file, Lib3dsNode *node, uint16_t parent_id, uint16_t *extra_id, Lib3dsIo *io) {
+    Lib3dsMeshInstanceNode copy;
+    Lib3dsMesh *mesh;
+    int index, nparts, i;
+
+    if (node->type != LIB3DS_NODE_MESH_INSTANCE) {
+        return;
+    }
+    index = lib3ds_file_mesh_by_name(file, node->name);
+    if (index < 0) {
+        return;
+    }
+    mesh = file->meshes[index];
+    if (!mesh_loaded(mesh) || 
+        ((mesh->nvertices <= LIB3DS_MESH_MAX_SIZE) && (mesh->nfaces <= LIB3DS_MESH_MAX_SIZE))) {
+        return;
+    }
+
+    nparts = lib3ds_mesh_split_count(mesh);
+    memcpy(&copy, node, sizeof(copy));
+    copy.base.next = copy.base.childs = NULL;
+    for (i = 1; i < nparts; ++i) {
+        lib3ds_mesh_part_name(copy.base.name, mesh->name, i);
+        lib3ds_node_write(&copy.base, (*extra_id)++, parent_id, io);
+    }
+}
+
+
+static void
+nodes_write(Lib3dsFile *file, Lib3dsNode *first_node, uint16_t *default_id, uint16_t *extra_id, uint16_t parent_id, Lib3dsIo *io) {
     Lib3dsNode *p;
     for (p = first_node; p != NULL; p = p->next) {
         uint16_t node_id;
@@ -827,8 +1721,9 @@ nodes_write(Lib3dsNode *first_node, uint16_t *default_id, uint16_t parent_id, Li
         }
         ++(*default_id);
         lib3ds_node_write(p, node_id, parent_id, io);
+        split_nodes_write(file, p, parent_id, extra_id, io);
 
-        nodes_write(p->childs, default_id, node_id, io);
+        nodes_write(file, p->childs, default_id, extra_id, node_id, io);
     }
 }
 
@@ -872,7 +1767,11 @@ kfdata_write(Lib3dsFile *file, Lib3dsIo *io) {
 
     {
         uint16_t default_id = 0;
-        nodes_write(file->nodes, &default_id, 65535, io);
+        uint16_t extra_id;
+        int max_id = -1;
+        int n = nodes_count(file->nodes, &max_id);
+        extra_id = (uint16_t)((n > max_id + 1)? n : max_id + 1);
+        nodes_write(file, file->nodes, &default_id, &extra_id, 65535, io);
     }
 
     lib3ds_chunk_write_end(&c, io);
@@ -882,6 +1781,11 @@ kfdata_write(Lib3dsFile *file, Lib3dsIo *io) {
 /*!
  * Write 3ds file data from a Lib3dsFile object to a file.
  *
+ * Meshes with more than 65535 vertices or faces are written as several 
+ * objects named "name", "name#1", ..., reading the file with the 
+ * LIB3DS_IO_MERGE_MESHES flag set joins them again. The node of such a
+ * mesh is written once for each part.
+ *
  * \param file The Lib3dsFile object to be written.
  * \param io A Lib3dsIo object previously set up by the caller.
  *
@@ -919,7 +1823,38 @@ lib3ds_file_write(Lib3dsFile *file, Lib3dsIo *io) {
 
     memset(impl->jmpbuf, 0, sizeof(impl->jmpbuf));
     lib3ds_io_cleanup(io);
-    return TRUE;
+    return !io->error;
+}
+
+
+/*!
+ * Write 3ds file data from a Lib3dsFile object to a stream that 
+ * does not need to be seekable.
+ *
+ * The file is serialised into a growable memory buffer first, where the
+ * chunk sizes are patched in place, and then emitted with a single 
+ * write. Only the write_func of io is used, so pipes, sockets or
+ * compressing streams are fine. The buffer holds the whole serialised
+ * file, seekable streams are better written by lib3ds_file_write().
+ *
+ * \param file The Lib3dsFile object to be written.
+ * \param io A Lib3dsIo object previously set up by the caller.
+ *
+ * \return LIB3DS_TRUE on success, LIB3DS_FALSE on failure.
+ */
+int
+lib3ds_file_write_buffered(Lib3dsFile *file, Lib3dsIo *io) {
+    Lib3dsIo memio;
+    Lib3dsIoMemory mem;
+    int result;
+
+    lib3ds_io_init_memory_buffer(&memio, &mem);
+    result = lib3ds_file_write(file, &memio);
+    if (result) {
+        result = (lib3ds_io_write(io, mem.data, mem.size) == mem.size);
+    }
+    lib3ds_io_free_memory_buffer(&mem);
+    return result;
 }
 
 
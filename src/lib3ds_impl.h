@@ -49,6 +49,14 @@ typedef signed __int16 int16_t;
 typedef signed __int32 int32_t;
 #endif
 
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__)
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define LIB3DS_LITTLE_ENDIAN
+#endif
+#elif defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define LIB3DS_LITTLE_ENDIAN
+#endif
+
 #ifndef TRUE
 #define TRUE 1
 #endif
@@ -320,6 +328,12 @@ typedef struct Lib3dsIoImpl {
     int log_indent;
     void *tmp_mem;
     Lib3dsNode *tmp_node;
+    struct Lib3dsMeshSplit *tmp_split;
+    long pos;               /* tracked stream position */
+    Lib3dsChunk header;     /* header of the chunk last returned by lib3ds_chunk_read_next */
+    int header_pending;     /* header was pushed back by lib3ds_chunk_read_reset */
+    Lib3dsReadCallbacks *callbacks;
+    int skip_objects;       /* materials and named objects are read by lib3ds_file_read_parallel */
 } Lib3dsIoImpl;
 
 extern void lib3ds_io_setup(Lib3dsIo *io);
@@ -330,6 +344,8 @@ extern long lib3ds_io_tell(Lib3dsIo *io);
 extern size_t lib3ds_io_read(Lib3dsIo *io, void *buffer, size_t size);
 extern size_t lib3ds_io_write(Lib3dsIo *io, const void *buffer, size_t size);
 extern void lib3ds_io_log(Lib3dsIo *io, Lib3dsLogLevel level, const char *format, ...);
+#define lib3ds_io_log_enabled(io, level) \
+    ((io)->log_func && (!((io)->flags & LIB3DS_IO_LOG_LEVEL) || ((level) <= (io)->log_level)))
 extern void lib3ds_io_log_indent(Lib3dsIo *io, int indent);
 extern void lib3ds_io_read_error(Lib3dsIo *io);
 extern void lib3ds_io_write_error(Lib3dsIo *io);
@@ -344,6 +360,10 @@ extern float lib3ds_io_read_float(Lib3dsIo *io);
 extern void lib3ds_io_read_vector(Lib3dsIo *io, float v[3]);
 extern void lib3ds_io_read_rgb(Lib3dsIo *io, float rgb[3]);
 extern void lib3ds_io_read_string(Lib3dsIo *io, char *s, int buflen);
+extern void lib3ds_io_read_words(Lib3dsIo *io, uint16_t *w, int n);
+extern void lib3ds_io_read_dwords(Lib3dsIo *io, uint32_t *d, int n);
+extern void lib3ds_io_read_floats(Lib3dsIo *io, float *f, int n);
+extern Lib3dsIoMemory* lib3ds_io_memory(Lib3dsIo *io);
 
 extern void lib3ds_io_write_byte(Lib3dsIo *io, uint8_t b);
 extern void lib3ds_io_write_word(Lib3dsIo *io, uint16_t w);
@@ -372,10 +392,27 @@ extern void lib3ds_light_read(Lib3dsLight *light, Lib3dsIo *io);
 extern void lib3ds_light_write(Lib3dsLight *light, Lib3dsIo *io);
 extern void lib3ds_mesh_read(Lib3dsFile *file, Lib3dsMesh *mesh, Lib3dsIo *io);
 extern void lib3ds_mesh_write(Lib3dsFile *file, Lib3dsMesh *mesh, Lib3dsIo *io);
+
+#define LIB3DS_MESH_MAX_SIZE 65535
+
+typedef struct Lib3dsMeshSplit Lib3dsMeshSplit;
+
+extern void lib3ds_mesh_part_name(char name[64], const char *base, int part);
+extern Lib3dsMeshSplit* lib3ds_mesh_split_new(Lib3dsMesh *mesh);
+extern Lib3dsMesh* lib3ds_mesh_split_next(Lib3dsMeshSplit *split);
+extern int lib3ds_mesh_split_count(Lib3dsMesh *mesh);
+extern void lib3ds_mesh_split_free(Lib3dsMeshSplit *split);
+
+struct Lib3dsTrackCache {
+    float (*rotations)[4];  /* absolute rotation of each key of a LIB3DS_TRACK_QUAT track */
+    float (*segments)[4][4];/* per segment ending at key i+1: start value, tangents and end value, or the squad control quaternions */
+};
+
 extern void lib3ds_track_read(Lib3dsTrack *track, Lib3dsIo *io);
 extern void lib3ds_track_write(Lib3dsTrack *track, Lib3dsIo *io);
 extern void lib3ds_node_read(Lib3dsNode *node, Lib3dsIo *io);
 extern void lib3ds_node_write(Lib3dsNode *node, uint16_t node_id, uint16_t parent_id, Lib3dsIo *io);
+extern void lib3ds_file_read_named_object(Lib3dsFile *file, Lib3dsIo *io);
 
 typedef void (*Lib3dsFreeFunc)(void *ptr);
 
@@ -384,6 +421,23 @@ extern void lib3ds_util_reserve_array(void ***ptr, int *n, int *size, int new_si
 extern void lib3ds_util_insert_array(void ***ptr, int *n, int *size, void *element, int index);
 extern void lib3ds_util_remove_array(void ***ptr, int *n, int index, Lib3dsFreeFunc free_func);
 
+extern void* lib3ds_util_heap_malloc(size_t size);
+extern void* lib3ds_util_heap_calloc(size_t size);
+extern void* lib3ds_util_heap_realloc(void *ptr, size_t size);
+extern void lib3ds_util_heap_free(void *ptr);
+extern Lib3dsArena* lib3ds_util_arena_new(size_t block_size);
+extern void lib3ds_util_arena_free(Lib3dsArena *arena);
+extern Lib3dsArena* lib3ds_util_arena_set(Lib3dsArena *arena);
+extern void* lib3ds_util_malloc(size_t size);
+extern void* lib3ds_util_calloc(size_t size);
+extern void* lib3ds_util_realloc(void *ptr, size_t size);
+extern void lib3ds_util_free(void *ptr);
+
+typedef void (*Lib3dsWorkFunc)(void *self, int index);
+
+extern int lib3ds_util_num_cpus();
+extern void lib3ds_util_parallel_for(int n, int nthreads, Lib3dsWorkFunc func, void *self);
+
 #ifdef __cplusplus
 }
 #endif
@@ -24,10 +24,193 @@ typedef union {
 } Lib3dsDwordFloat;
 
 
+static long
+memio_seek_func(void *self, long offset, Lib3dsIoSeek origin) {
+    Lib3dsIoMemory *mem = (Lib3dsIoMemory*)self;
+    long pos;
+    switch (origin) {
+        case LIB3DS_SEEK_SET:
+            pos = offset;
+            break;
+
+        case LIB3DS_SEEK_CUR:
+            pos = (long)mem->pos + offset;
+            break;
+
+        case LIB3DS_SEEK_END:
+            pos = (long)mem->size + offset;
+            break;
+
+        default:
+            assert(0);
+            return(-1);
+    }
+    if (pos < 0) {
+        return(-1);
+    }
+    mem->pos = (size_t)pos;
+    return(0);
+}
+
+
+static long
+memio_tell_func(void *self) {
+    Lib3dsIoMemory *mem = (Lib3dsIoMemory*)self;
+    return((long)mem->pos);
+}
+
+
+static size_t
+memio_read_func(void *self, void *buffer, size_t size) {
+    Lib3dsIoMemory *mem = (Lib3dsIoMemory*)self;
+    if (mem->pos >= mem->size) {
+        return(0);
+    }
+    if (size > mem->size - mem->pos) {
+        size = mem->size - mem->pos;
+    }
+    memcpy(buffer, mem->data + mem->pos, size);
+    mem->pos += size;
+    return(size);
+}
+
+
+static size_t
+memio_write_func(void *self, const void *buffer, size_t size) {
+    Lib3dsIoMemory *mem = (Lib3dsIoMemory*)self;
+    if (!mem->capacity && mem->data) {
+        /* caller owned read-only data */
+        return(0);
+    }
+    if (mem->pos + size > mem->capacity) {
+        size_t capacity = mem->capacity? 2 * mem->capacity : 65536;
+        unsigned char *p;
+        while (capacity < mem->pos + size) {
+            capacity *= 2;
+        }
+        p = (unsigned char*)lib3ds_util_heap_realloc(mem->data, capacity);
+        if (!p) {
+            return(0);
+        }
+        mem->data = p;
+        mem->capacity = capacity;
+    }
+    if (mem->pos > mem->size) {
+        memset(mem->data + mem->size, 0, mem->pos - mem->size);
+    }
+    memcpy(mem->data + mem->pos, buffer, size);
+    mem->pos += size;
+    if (mem->pos > mem->size) {
+        mem->size = mem->pos;
+    }
+    return(size);
+}
+
+
+static void
+memio_init(Lib3dsIo *io, Lib3dsIoMemory *mem) {
+    memset(io, 0, sizeof(*io));
+    io->self = mem;
+    io->seek_func = memio_seek_func;
+    io->tell_func = memio_tell_func;
+    io->read_func = memio_read_func;
+    io->write_func = memio_write_func;
+    io->log_func = NULL;
+}
+
+
+void
+lib3ds_io_init_memory(Lib3dsIo *io, Lib3dsIoMemory *mem, const void *data, size_t size) {
+    assert(io && mem);
+    mem->data = (unsigned char*)data;
+    mem->size = size;
+    mem->capacity = 0;
+    mem->pos = 0;
+    memio_init(io, mem);
+}
+
+
+void
+lib3ds_io_init_memory_buffer(Lib3dsIo *io, Lib3dsIoMemory *mem) {
+    assert(io && mem);
+    memset(mem, 0, sizeof(*mem));
+    memio_init(io, mem);
+}
+
+
+void
+lib3ds_io_free_memory_buffer(Lib3dsIoMemory *mem) {
+    assert(mem);
+    if (mem->capacity) {
+        lib3ds_util_heap_free(mem->data);
+    }
+    memset(mem, 0, sizeof(*mem));
+}
+
+
+/*!
+ * Returns the stream state if io was set up by lib3ds_io_init_memory()
+ * or lib3ds_io_init_memory_buffer(), NULL otherwise.
+ */
+Lib3dsIoMemory*
+lib3ds_io_memory(Lib3dsIo *io) {
+    return (io->read_func == memio_read_func)? (Lib3dsIoMemory*)io->self : NULL;
+}
+
+
+/*!
+ * Returns a pointer to the next size bytes of the input stream. 
+ *
+ * For memory streams the data is returned in place, otherwise it is
+ * read into buffer.
+ */
+static const uint8_t*
+io_read_raw(Lib3dsIo *io, uint8_t *buffer, size_t size) {
+    if (io->read_func == memio_read_func) {
+        Lib3dsIoMemory *mem = (Lib3dsIoMemory*)io->self;
+        if ((mem->pos <= mem->size) && (mem->size - mem->pos >= size)) {
+            const uint8_t *p = mem->data + mem->pos;
+            mem->pos += size;
+            return p;
+        }
+    }
+    lib3ds_io_read(io, buffer, size);
+    return buffer;
+}
+
+
+/*!
+ * Reads size bytes of the input stream into buffer. Bytes beyond 
+ * the end of the stream are set to zero.
+ */
+static void
+io_read_array(Lib3dsIo *io, void *buffer, size_t size) {
+    size_t n;
+    if (io->read_func == memio_read_func) {
+        Lib3dsIoMemory *mem = (Lib3dsIoMemory*)io->self;
+        if ((mem->pos <= mem->size) && (mem->size - mem->pos >= size)) {
+            memcpy(buffer, mem->data + mem->pos, size);
+            mem->pos += size;
+            return;
+        }
+    }
+    n = lib3ds_io_read(io, buffer, size);
+    if (n < size) {
+        memset((char*)buffer + n, 0, size - n);
+    }
+}
+
+
 void
 lib3ds_io_setup(Lib3dsIo *io) {
+    Lib3dsIoImpl *impl;
     assert(io);
-    io->impl = calloc(sizeof(Lib3dsIoImpl), 1);
+    impl = (Lib3dsIoImpl*)lib3ds_util_heap_calloc(sizeof(Lib3dsIoImpl));
+    if (io->tell_func && (io->tell_func != memio_tell_func)) {
+        impl->pos = (*io->tell_func)(io->self);
+    }
+    io->impl = impl;
+    io->error = FALSE;
 }
 
 
@@ -37,31 +220,106 @@ lib3ds_io_cleanup(Lib3dsIo *io) {
     assert(io);
     impl = (Lib3dsIoImpl*)io->impl;
     if (impl->tmp_mem) {
-        free(impl->tmp_mem);
+        lib3ds_util_heap_free(impl->tmp_mem);
         impl->tmp_mem = NULL;
     }
     if (impl->tmp_node) {
         lib3ds_node_free(impl->tmp_node);
         impl->tmp_node = NULL;
     }
-    free(impl);
+    if (impl->tmp_split) {
+        lib3ds_mesh_split_free(impl->tmp_split);
+        impl->tmp_split = NULL;
+    }
+    lib3ds_util_heap_free(impl);
+    io->impl = NULL;
 }
 
 
+/*!
+ * Skips forward by reading and discarding data, used for streams
+ * which can not seek.
+ */
+static void
+io_skip(Lib3dsIo *io, long size) {
+    char buffer[4096];
+    while (size > 0) {
+        size_t n = (size < (long)sizeof(buffer))? (size_t)size : sizeof(buffer);
+        if (lib3ds_io_read(io, buffer, n) != n) {
+            lib3ds_io_read_error(io);
+            return;
+        }
+        size -= (long)n;
+    }
+}
+
+
+/*!
+ * Sets the stream position. 
+ *
+ * The position is tracked while reading or writing a file, so seeking 
+ * to the current position is free. Streams without seek_func are 
+ * forward-only: seeking forward reads and discards data, seeking 
+ * backward is an error.
+ */
 long
 lib3ds_io_seek(Lib3dsIo *io, long offset, Lib3dsIoSeek origin) {
+    Lib3dsIoImpl *impl;
+    long result;
+
     assert(io);
-    if (!io || !io->seek_func) {
+    if (!io) {
         return 0;
     }
-    return (*io->seek_func)(io->self, offset, origin);
+    if (io->seek_func == memio_seek_func) {
+        return memio_seek_func(io->self, offset, origin);
+    }
+
+    impl = (Lib3dsIoImpl*)io->impl;
+    if (impl && (origin != LIB3DS_SEEK_END)) {
+        long pos = (origin == LIB3DS_SEEK_SET)? offset : impl->pos + offset;
+        if (pos == impl->pos) {
+            return 0;
+        }
+        if (!io->seek_func) {
+            if (pos < impl->pos) {
+                lib3ds_io_log(io, LIB3DS_LOG_ERROR, "Seeking backwards in forward-only stream.");
+                return -1;
+            }
+            io_skip(io, pos - impl->pos);
+            return 0;
+        }
+        result = (*io->seek_func)(io->self, pos, LIB3DS_SEEK_SET);
+        if (result == 0) {
+            impl->pos = pos;
+        }
+        return result;
+    }
+
+    if (!io->seek_func) {
+        return 0;
+    }
+    result = (*io->seek_func)(io->self, offset, origin);
+    if (impl && io->tell_func) {
+        impl->pos = (*io->tell_func)(io->self);
+    }
+    return result;
 }
 
 
 long
 lib3ds_io_tell(Lib3dsIo *io) {
     assert(io);
-    if (!io || !io->tell_func) {
+    if (!io) {
+        return 0;
+    }
+    if (io->tell_func == memio_tell_func) {
+        return (long)((Lib3dsIoMemory*)io->self)->pos;
+    }
+    if (io->impl) {
+        return ((Lib3dsIoImpl*)io->impl)->pos;
+    }
+    if (!io->tell_func) {
         return 0;
     }
     return (*io->tell_func)(io->self);
@@ -74,7 +332,16 @@ lib3ds_io_read(Lib3dsIo *io, void *buffer, size_t size) {
     if (!io || !io->read_func) {
         return 0;
     }
-    return (*io->read_func)(io->self, buffer, size);
+    if (io->read_func == memio_read_func) {
+        return memio_read_func(io->self, buffer, size);
+    }
+    {
+        size_t n = (*io->read_func)(io->self, buffer, size);
+        if (io->impl) {
+            ((Lib3dsIoImpl*)io->impl)->pos += (long)n;
+        }
+        return n;
+    }
 }
 
 
@@ -84,7 +351,16 @@ lib3ds_io_write(Lib3dsIo *io, const void *buffer, size_t size) {
     if (!io || !io->write_func) {
         return 0;
     }
-    return (*io->write_func)(io->self, buffer, size);
+    if (io->write_func == memio_write_func) {
+        return memio_write_func(io->self, buffer, size);
+    }
+    {
+        size_t n = (*io->write_func)(io->self, buffer, size);
+        if (io->impl) {
+            ((Lib3dsIoImpl*)io->impl)->pos += (long)n;
+        }
+        return n;
+    }
 }
 
 
@@ -96,21 +372,48 @@ lib3ds_io_log_str(Lib3dsIo *io, Lib3dsLogLevel level, const char *str) {
 }
 
 
+/*!
+ * Formats a message and passes it to the log function. With the 
+ * LIB3DS_IO_LOG_LEVEL flag set, messages more verbose than 
+ * io->log_level are dropped before formatting.
+ *
+ * Errors abort the current read or write by longjmp if a log function
+ * is set, as before. With LIB3DS_IO_STICKY_ERRORS they are recorded in
+ * io->error instead, with or without log function. Otherwise they are
+ * ignored and reading goes on.
+ */
 void 
 lib3ds_io_log(Lib3dsIo *io, Lib3dsLogLevel level, const char *format, ...) {
     va_list args;
-    /* FIXME */ char str[1024];
+    char str[1024];
 
     assert(io);
-    if (!io || !io->log_func)
+    if (!io)
         return;
 
-    va_start(args, format);
-    /* FIXME: */ vsprintf(str, format, args); 
-    lib3ds_io_log_str(io, level, str);
+    if (lib3ds_io_log_enabled(io, level)) {
+        va_start(args, format);
+#ifdef _MSC_VER
+        _vsnprintf(str, sizeof(str), format, args);
+#else
+        vsnprintf(str, sizeof(str), format, args);
+#endif
+        va_end(args);
+        str[sizeof(str) - 1] = 0;
+        lib3ds_io_log_str(io, level, str);
+    }
 
+    /* without a log function errors are only fatal if 
+       LIB3DS_IO_STICKY_ERRORS asks for them to be recorded */
     if (level == LIB3DS_LOG_ERROR) {
-        longjmp(((Lib3dsIoImpl*)io->impl)->jmpbuf, 1);
+        if (io->flags & LIB3DS_IO_STICKY_ERRORS) {
+            io->error = TRUE;
+        } else if (io->log_func) {
+            io->error = TRUE;
+            if (io->impl) {
+                longjmp(((Lib3dsIoImpl*)io->impl)->jmpbuf, 1);
+            }
+        }
     }
 }
 
@@ -141,11 +444,10 @@ lib3ds_io_write_error(Lib3dsIo *io) {
  */
 uint8_t
 lib3ds_io_read_byte(Lib3dsIo *io) {
-    uint8_t b;
+    uint8_t b = 0;
 
     assert(io);
-    lib3ds_io_read(io, &b, 1);
-    return(b);
+    return(*io_read_raw(io, &b, 1));
 }
 
 
@@ -154,11 +456,12 @@ lib3ds_io_read_byte(Lib3dsIo *io) {
  */
 uint16_t
 lib3ds_io_read_word(Lib3dsIo *io) {
-    uint8_t b[2];
+    uint8_t buffer[2] = {0};
+    const uint8_t *b;
     uint16_t w;
 
     assert(io);
-    lib3ds_io_read(io, b, 2);
+    b = io_read_raw(io, buffer, 2);
     w = ((uint16_t)b[1] << 8) |
         ((uint16_t)b[0]);
     return(w);
@@ -170,11 +473,12 @@ lib3ds_io_read_word(Lib3dsIo *io) {
  */
 uint32_t
 lib3ds_io_read_dword(Lib3dsIo *io) {
-    uint8_t b[4];
+    uint8_t buffer[4] = {0};
+    const uint8_t *b;
     uint32_t d;
 
     assert(io);
-    lib3ds_io_read(io, b, 4);
+    b = io_read_raw(io, buffer, 4);
     d = ((uint32_t)b[3] << 24) |
         ((uint32_t)b[2] << 16) |
         ((uint32_t)b[1] << 8) |
@@ -188,11 +492,10 @@ lib3ds_io_read_dword(Lib3dsIo *io) {
  */
 int8_t
 lib3ds_io_read_intb(Lib3dsIo *io) {
-    int8_t b;
+    uint8_t b = 0;
 
     assert(io);
-    lib3ds_io_read(io, &b, 1);
-    return(b);
+    return((int8_t)*io_read_raw(io, &b, 1));
 }
 
 
@@ -201,11 +504,12 @@ lib3ds_io_read_intb(Lib3dsIo *io) {
  */
 int16_t
 lib3ds_io_read_intw(Lib3dsIo *io) {
-    uint8_t b[2];
+    uint8_t buffer[2] = {0};
+    const uint8_t *b;
     uint16_t w;
 
     assert(io);
-    lib3ds_io_read(io, b, 2);
+    b = io_read_raw(io, buffer, 2);
     w = ((uint16_t)b[1] << 8) |
         ((uint16_t)b[0]);
     return((int16_t)w);
@@ -217,11 +521,12 @@ lib3ds_io_read_intw(Lib3dsIo *io) {
  */
 int32_t
 lib3ds_io_read_intd(Lib3dsIo *io) {
-    uint8_t b[4];
+    uint8_t buffer[4] = {0};
+    const uint8_t *b;
     uint32_t d;
 
     assert(io);
-    lib3ds_io_read(io, b, 4);
+    b = io_read_raw(io, buffer, 4);
     d = ((uint32_t)b[3] << 24) |
         ((uint32_t)b[2] << 16) |
         ((uint32_t)b[1] << 8) |
@@ -235,11 +540,12 @@ lib3ds_io_read_intd(Lib3dsIo *io) {
  */
 float
 lib3ds_io_read_float(Lib3dsIo *io) {
-    uint8_t b[4];
+    uint8_t buffer[4] = {0};
+    const uint8_t *b;
     Lib3dsDwordFloat d;
 
     assert(io);
-    lib3ds_io_read(io, b, 4);
+    b = io_read_raw(io, buffer, 4);
     d.dword_value = ((uint32_t)b[3] << 24) |
                     ((uint32_t)b[2] << 16) |
                     ((uint32_t)b[1] << 8) |
@@ -257,18 +563,104 @@ lib3ds_io_read_float(Lib3dsIo *io) {
 void
 lib3ds_io_read_vector(Lib3dsIo *io, float v[3]) {
     assert(io);
-    v[0] = lib3ds_io_read_float(io);
-    v[1] = lib3ds_io_read_float(io);
-    v[2] = lib3ds_io_read_float(io);
+    lib3ds_io_read_floats(io, v, 3);
 }
 
 
 void
 lib3ds_io_read_rgb(Lib3dsIo *io, float rgb[3]) {
     assert(io);
-    rgb[0] = lib3ds_io_read_float(io);
-    rgb[1] = lib3ds_io_read_float(io);
-    rgb[2] = lib3ds_io_read_float(io);
+    lib3ds_io_read_floats(io, rgb, 3);
+}
+
+
+/*!
+ * Read an array of words from a file stream in little endian format.
+ * On little endian hosts this is a plain copy.
+ *
+ * \param io IO input handle.
+ * \param w  The array to store the data.
+ * \param n  Number of words to read.
+ */
+void
+lib3ds_io_read_words(Lib3dsIo *io, uint16_t *w, int n) {
+    assert(io);
+    if (n <= 0) {
+        return;
+    }
+    io_read_array(io, w, 2 * (size_t)n);
+#ifndef LIB3DS_LITTLE_ENDIAN
+    {
+        const uint8_t *b = (const uint8_t*)w;
+        int i;
+        for (i = 0; i < n; ++i, b += 2) {
+            w[i] = ((uint16_t)b[1] << 8) |
+                   ((uint16_t)b[0]);
+        }
+    }
+#endif
+}
+
+
+/*!
+ * Read an array of dwords from a file stream in little endian format.
+ * On little endian hosts this is a plain copy.
+ *
+ * \param io IO input handle.
+ * \param d  The array to store the data.
+ * \param n  Number of dwords to read.
+ */
+void
+lib3ds_io_read_dwords(Lib3dsIo *io, uint32_t *d, int n) {
+    assert(io);
+    if (n <= 0) {
+        return;
+    }
+    io_read_array(io, d, 4 * (size_t)n);
+#ifndef LIB3DS_LITTLE_ENDIAN
+    {
+        const uint8_t *b = (const uint8_t*)d;
+        int i;
+        for (i = 0; i < n; ++i, b += 4) {
+            d[i] = ((uint32_t)b[3] << 24) |
+                   ((uint32_t)b[2] << 16) |
+                   ((uint32_t)b[1] << 8) |
+                   ((uint32_t)b[0]);
+        }
+    }
+#endif
+}
+
+
+/*!
+ * Read an array of floats from a file stream in little endian format.
+ * On little endian hosts this is a plain copy.
+ *
+ * \param io IO input handle.
+ * \param f  The array to store the data.
+ * \param n  Number of floats to read.
+ */
+void
+lib3ds_io_read_floats(Lib3dsIo *io, float *f, int n) {
+    assert(io);
+    if (n <= 0) {
+        return;
+    }
+    io_read_array(io, f, 4 * (size_t)n);
+#ifndef LIB3DS_LITTLE_ENDIAN
+    {
+        const uint8_t *b = (const uint8_t*)f;
+        Lib3dsDwordFloat d;
+        int i;
+        for (i = 0; i < n; ++i, b += 4) {
+            d.dword_value = ((uint32_t)b[3] << 24) |
+                            ((uint32_t)b[2] << 16) |
+                            ((uint32_t)b[1] << 8) |
+                            ((uint32_t)b[0]);
+            f[i] = d.float_value;
+        }
+    }
+#endif
 }
 
 
@@ -289,7 +681,9 @@ lib3ds_io_read_string(Lib3dsIo *io, char *s, int buflen) {
     assert(io);
     for (;;) {
         if (lib3ds_io_read(io, &c, 1) != 1) {
+            *s = 0;
             lib3ds_io_read_error(io);
+            return;
         }
         *s++ = c;
         if (!c) {
@@ -297,7 +691,9 @@ lib3ds_io_read_string(Lib3dsIo *io, char *s, int buflen) {
         }
         ++k;
         if (k >= buflen) {
+            s[-1] = 0;
             lib3ds_io_log(io, LIB3DS_LOG_ERROR, "Invalid string in input stream.");
+            return;
         }
     }
 }
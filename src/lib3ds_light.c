@@ -25,7 +25,7 @@ lib3ds_light_new(const char *name) {
     assert(name);
     assert(strlen(name) < 64);
 
-    light = (Lib3dsLight*)calloc(sizeof(Lib3dsLight), 1);
+    light = (Lib3dsLight*)lib3ds_util_calloc(sizeof(Lib3dsLight));
     if (!light) {
         return(0);
     }
@@ -37,7 +37,7 @@ lib3ds_light_new(const char *name) {
 void
 lib3ds_light_free(Lib3dsLight *light) {
     memset(light, 0, sizeof(Lib3dsLight));
-    free(light);
+    lib3ds_util_free(light);
 }
 
 
@@ -39,7 +39,7 @@ Lib3dsMaterial*
 lib3ds_material_new(const char* name) {
     Lib3dsMaterial *mat;
 
-    mat = (Lib3dsMaterial*)calloc(sizeof(Lib3dsMaterial), 1);
+    mat = (Lib3dsMaterial*)lib3ds_util_calloc(sizeof(Lib3dsMaterial));
     if (!mat) {
         return(0);
     }
@@ -78,7 +78,7 @@ lib3ds_material_new(const char* name) {
 void
 lib3ds_material_free(Lib3dsMaterial *material) {
     memset(material, 0, sizeof(Lib3dsMaterial));
-    free(material);
+    lib3ds_util_free(material);
 }
 
 
@@ -37,7 +37,7 @@ lib3ds_mesh_new(const char *name) {
     assert(name);
     assert(strlen(name) < 64);
 
-    mesh = (Lib3dsMesh*) calloc(sizeof(Lib3dsMesh), 1);
+    mesh = (Lib3dsMesh*)lib3ds_util_calloc(sizeof(Lib3dsMesh));
     if (!mesh) {
         return (0);
     }
@@ -58,7 +58,7 @@ lib3ds_mesh_free(Lib3dsMesh *mesh) {
     lib3ds_mesh_resize_vertices(mesh, 0, 0, 0);
     lib3ds_mesh_resize_faces(mesh, 0);
     memset(mesh, 0, sizeof(Lib3dsMesh));
-    free(mesh);
+    lib3ds_util_free(mesh);
 }
 
 
@@ -78,7 +78,7 @@ lib3ds_mesh_resize_vertices(Lib3dsMesh *mesh, int nvertices, int use_texcos, int
         use_flags? nvertices : 0, 
         2 * sizeof(float)
     );
-    mesh->nvertices = (unsigned short)nvertices;
+    mesh->nvertices = nvertices;
 }
 
 
@@ -90,7 +90,99 @@ lib3ds_mesh_resize_faces(Lib3dsMesh *mesh, int nfaces) {
     for (i = mesh->nfaces; i < nfaces; ++i) {
         mesh->faces[i].material = -1;
     }
-    mesh->nfaces = (unsigned short)nfaces;
+    mesh->nfaces = nfaces;
+}
+
+
+/*!
+ * Reads the geometry of a mesh which was read with the 
+ * LIB3DS_IO_LAZY_MESHES flag set.
+ *
+ * The stream is accessed at mesh->data_offset, so io has to provide
+ * the same data that was used for reading the file, typically a 
+ * memory block or a mapped file set up with lib3ds_io_init_memory().
+ * Does nothing if the geometry is already present. The geometry is 
+ * allocated from the heap even if file was created by 
+ * lib3ds_file_new_arena(), so lib3ds_mesh_unload() releases it.
+ *
+ * \param file The file the mesh belongs to, used to resolve materials.
+ * \param mesh The mesh object.
+ * \param io   The stream the file was read from.
+ *
+ * \return LIB3DS_TRUE on success, LIB3DS_FALSE on failure.
+ */
+int
+lib3ds_mesh_load(Lib3dsFile *file, Lib3dsMesh *mesh, Lib3dsIo *io) {
+    Lib3dsIoImpl *impl;
+    Lib3dsArena *arena;
+    unsigned flags;
+    int nvertices, nfaces;
+
+    assert(mesh);
+    if (!mesh->data_offset || mesh->vertices || mesh->faces) {
+        return TRUE;
+    }
+
+    flags = io->flags;
+    nvertices = mesh->nvertices;
+    nfaces = mesh->nfaces;
+    mesh->nvertices = 0;
+    mesh->nfaces = 0;
+
+    lib3ds_io_setup(io);
+    impl = (Lib3dsIoImpl*)io->impl;
+    arena = lib3ds_util_arena_set(NULL);
+    if (setjmp(impl->jmpbuf) != 0) {
+        lib3ds_io_cleanup(io);
+        lib3ds_util_arena_set(arena);
+        io->flags = flags;
+        lib3ds_mesh_resize_vertices(mesh, 0, 0, 0);
+        lib3ds_mesh_resize_faces(mesh, 0);
+        mesh->nvertices = nvertices;
+        mesh->nfaces = nfaces;
+        return FALSE;
+    }
+
+    io->flags &= ~LIB3DS_IO_LAZY_MESHES;
+    lib3ds_io_seek(io, (long)mesh->data_offset, LIB3DS_SEEK_SET);
+    lib3ds_mesh_read(file, mesh, io);
+
+    memset(impl->jmpbuf, 0, sizeof(impl->jmpbuf));
+    lib3ds_io_cleanup(io);
+    lib3ds_util_arena_set(arena);
+    io->flags = flags;
+    if (io->error) {
+        lib3ds_mesh_resize_vertices(mesh, 0, 0, 0);
+        lib3ds_mesh_resize_faces(mesh, 0);
+        mesh->nvertices = nvertices;
+        mesh->nfaces = nfaces;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+
+/*!
+ * Releases the geometry of a mesh read with the LIB3DS_IO_LAZY_MESHES 
+ * flag set. The vertex and face counts are kept, lib3ds_mesh_load() 
+ * reads the geometry again. Meshes not read lazily are left untouched.
+ *
+ * \param mesh The mesh object.
+ */
+void
+lib3ds_mesh_unload(Lib3dsMesh *mesh) {
+    int nvertices, nfaces;
+
+    assert(mesh);
+    if (!mesh->data_offset) {
+        return;
+    }
+    nvertices = mesh->nvertices;
+    nfaces = mesh->nfaces;
+    lib3ds_mesh_resize_vertices(mesh, 0, 0, 0);
+    lib3ds_mesh_resize_faces(mesh, 0);
+    mesh->nvertices = nvertices;
+    mesh->nfaces = nfaces;
 }
 
 
@@ -107,6 +199,9 @@ lib3ds_mesh_bounding_box(Lib3dsMesh *mesh, float bmin[3], float bmax[3]) {
     bmin[0] = bmin[1] = bmin[2] = FLT_MAX;
     bmax[0] = bmax[1] = bmax[2] = -FLT_MAX;
 
+    if (!mesh->vertices) {
+        return;
+    }
     for (i = 0; i < mesh->nvertices; ++i) {
         lib3ds_vector_min(bmin, mesh->vertices[i]);
         lib3ds_vector_max(bmax, mesh->vertices[i]);
@@ -132,11 +227,104 @@ lib3ds_mesh_calculate_face_normals(Lib3dsMesh *mesh, float (*face_normals)[3]) {
 }
 
 
-typedef struct Lib3dsFaces {
-    struct Lib3dsFaces *next;
-    int index;
-    float normal[3];
-} Lib3dsFaces;
+typedef struct Lib3dsNormals {
+    Lib3dsMesh *mesh;
+    float (*normals)[3];
+    float (*corners)[3];    /* angle weighted normal of each face corner */
+    int *first;             /* corners of vertex v are adjacent[first[v]] .. adjacent[first[v + 1] - 1] */
+    int *adjacent;          /* corner indices 3 * face + j, ascending for each vertex */
+    int valence;            /* maximum number of corners of a vertex */
+} Lib3dsNormals;
+
+#define LIB3DS_NORMALS_BLOCK 4096
+
+
+static void
+normals_corners(void *self, int block) {
+    Lib3dsNormals *p = (Lib3dsNormals*)self;
+    Lib3dsMesh *mesh = p->mesh;
+    int i = block * LIB3DS_NORMALS_BLOCK;
+    int end = (i + LIB3DS_NORMALS_BLOCK < mesh->nfaces)? i + LIB3DS_NORMALS_BLOCK : mesh->nfaces;
+    int j;
+
+    for (; i < end; ++i) {
+        unsigned *index = mesh->faces[i].index;
+        for (j = 0; j < 3; ++j) {
+            float p0[3], q[3], n[3];
+            float len, weight;
+
+            lib3ds_vector_sub(p0, mesh->vertices[index[j<2? j + 1 : 0]], mesh->vertices[index[j]]);
+            lib3ds_vector_sub(q, mesh->vertices[index[j>0? j - 1 : 2]], mesh->vertices[index[j]]);
+            lib3ds_vector_cross(n, p0, q);
+            len = lib3ds_vector_length(n);
+            if (len > 0) {
+                weight = (float)atan2(len, lib3ds_vector_dot(p0, q));
+                lib3ds_vector_scalar_mul(p->corners[3*i+j], n, weight / len);
+            } else {
+                lib3ds_vector_zero(p->corners[3*i+j]);
+            }
+        }
+    }
+}
+
+
+/* Corners of a vertex whose faces have the same smoothing group get 
+   the same normal, so it is only summed up once per distinct group. 
+   The corners are visited from the last face to the first, the order
+   in which the normals were always accumulated. */
+static void
+normals_vertices(void *self, int block) {
+    Lib3dsNormals *p = (Lib3dsNormals*)self;
+    Lib3dsFace *faces = p->mesh->faces;
+    int v = block * LIB3DS_NORMALS_BLOCK;
+    int end = (v + LIB3DS_NORMALS_BLOCK < p->mesh->nvertices)? v + LIB3DS_NORMALS_BLOCK : p->mesh->nvertices;
+    unsigned *groups = (unsigned*)lib3ds_util_heap_malloc(p->valence * sizeof(unsigned));
+    int *results = (int*)lib3ds_util_heap_malloc(p->valence * sizeof(int));
+
+    for (; v < end; ++v) {
+        int begin = p->first[v], last = p->first[v + 1] - 1;
+        int ngroups = 0;
+        int k, l;
+
+        for (k = begin; k <= last; ++k) {
+            int corner = p->adjacent[k];
+            unsigned smoothing_group = faces[corner / 3].smoothing_group;
+            float n[3];
+
+            if (!smoothing_group) {
+                lib3ds_vector_copy(n, p->corners[corner]);
+                lib3ds_vector_normalize(n);
+                lib3ds_vector_copy(p->normals[corner], n);
+                continue;
+            }
+            for (l = 0; (l < ngroups) && (groups[l] != smoothing_group); ++l);
+            if (l < ngroups) {
+                lib3ds_vector_copy(p->normals[corner], p->normals[results[l]]);
+                continue;
+            }
+            groups[ngroups] = smoothing_group;
+            results[ngroups++] = corner;
+
+            for (l = last; l >= begin; --l) {
+                unsigned g = faces[p->adjacent[l] / 3].smoothing_group;
+                if (g & faces[corner / 3].smoothing_group) {
+                    smoothing_group |= g;
+                }
+            }
+            lib3ds_vector_zero(n);
+            for (l = last; l >= begin; --l) {
+                if (smoothing_group & faces[p->adjacent[l] / 3].smoothing_group) {
+                    lib3ds_vector_add(n, n, p->corners[p->adjacent[l]]);
+                }
+            }
+            lib3ds_vector_normalize(n);
+            lib3ds_vector_copy(p->normals[corner], n);
+        }
+    }
+
+    lib3ds_util_heap_free(results);
+    lib3ds_util_heap_free(groups);
+}
 
 
 /*!
@@ -161,76 +349,354 @@ typedef struct Lib3dsFaces {
  */
 void
 lib3ds_mesh_calculate_vertex_normals(Lib3dsMesh *mesh, float (*normals)[3]) {
-    Lib3dsFaces **fl;
-    Lib3dsFaces *fa;
+    lib3ds_mesh_calculate_vertex_normals_parallel(mesh, normals, 1);
+}
+
+
+/*!
+ * Same as lib3ds_mesh_calculate_vertex_normals(), with the work split
+ * across multiple threads. The results do not depend on the number 
+ * of threads.
+ *
+ * \param mesh      A pointer to the mesh to calculate the normals for.
+ * \param normals   A pointer to a buffer of 3*mesh->nfaces normals.
+ * \param nthreads  Number of threads, 0 to use all processors.
+ */
+void
+lib3ds_mesh_calculate_vertex_normals_parallel(Lib3dsMesh *mesh, float (*normals)[3], int nthreads) {
+    Lib3dsNormals p;
+    int *count;
     int i, j;
 
     if (!mesh->nfaces) {
         return;
     }
 
-    fl = (Lib3dsFaces**)calloc(sizeof(Lib3dsFaces*), mesh->nvertices);
-    fa = (Lib3dsFaces*)malloc(sizeof(Lib3dsFaces) * 3 * mesh->nfaces);
+    p.mesh = mesh;
+    p.normals = normals;
+    p.corners = (float(*)[3])lib3ds_util_heap_malloc(sizeof(float) * 9 * mesh->nfaces);
+    p.first = (int*)lib3ds_util_heap_calloc(sizeof(int) * (mesh->nvertices + 1));
+    p.adjacent = (int*)lib3ds_util_heap_malloc(sizeof(int) * 3 * mesh->nfaces);
 
+    /* vertex -> corner adjacency in compressed sparse row form */
+    count = p.first + 1;
     for (i = 0; i < mesh->nfaces; ++i) {
         for (j = 0; j < 3; ++j) {
-            Lib3dsFaces* l = &fa[3*i+j];
-            float p[3], q[3], n[3];
-            float len, weight;
+            assert(mesh->faces[i].index[j] < (unsigned)mesh->nvertices);
+            ++count[mesh->faces[i].index[j]];
+        }
+    }
+    p.valence = 0;
+    for (i = 0; i < mesh->nvertices; ++i) {
+        if (count[i] > p.valence) {
+            p.valence = count[i];
+        }
+        count[i] += p.first[i];
+    }
+    for (i = 0; i < mesh->nfaces; ++i) {
+        for (j = 0; j < 3; ++j) {
+            p.adjacent[p.first[mesh->faces[i].index[j]]++] = 3 * i + j;
+        }
+    }
+    for (i = mesh->nvertices; i > 0; --i) {
+        p.first[i] = p.first[i - 1];
+    }
+    p.first[0] = 0;
 
-            l->index = i;
-            l->next = fl[mesh->faces[i].index[j]];
-            fl[mesh->faces[i].index[j]] = l;
+    lib3ds_util_parallel_for(
+        (mesh->nfaces + LIB3DS_NORMALS_BLOCK - 1) / LIB3DS_NORMALS_BLOCK, nthreads, normals_corners, &p
+    );
+    lib3ds_util_parallel_for(
+        (mesh->nvertices + LIB3DS_NORMALS_BLOCK - 1) / LIB3DS_NORMALS_BLOCK, nthreads, normals_vertices, &p
+    );
 
-            lib3ds_vector_sub(p, mesh->vertices[mesh->faces[i].index[j<2? j + 1 : 0]], mesh->vertices[mesh->faces[i].index[j]]);
-            lib3ds_vector_sub(q, mesh->vertices[mesh->faces[i].index[j>0? j - 1 : 2]], mesh->vertices[mesh->faces[i].index[j]]);
-            lib3ds_vector_cross(n, p, q);
-            len = lib3ds_vector_length(n);
-            if (len > 0) {       
-                weight = (float)atan2(len, lib3ds_vector_dot(p, q));
-                lib3ds_vector_scalar_mul(l->normal, n, weight / len);
-            } else {
-                lib3ds_vector_zero(l->normal);
+    lib3ds_util_heap_free(p.adjacent);
+    lib3ds_util_heap_free(p.first);
+    lib3ds_util_heap_free(p.corners);
+}
+
+
+/*!
+ * Creates an indexed vertex stream of a mesh with smooth normals, as
+ * needed for vertex and index buffers. A vertex of the mesh is split
+ * only where the smoothing groups of its faces give different normals,
+ * the normals are the same as by lib3ds_mesh_calculate_vertex_normals().
+ * Vertices are numbered in the order they are first used by the faces,
+ * vertices not used by any face are left out.
+ *
+ * \param mesh      The mesh object.
+ * \param nthreads  Number of threads for calculating the normals, 
+ *                  0 to use all processors.
+ *
+ * \return The new object, to be freed with lib3ds_mesh_indexed_free(),
+ *         or NULL if the mesh data is not loaded (see lib3ds_mesh_load()).
+ */
+Lib3dsMeshIndexed*
+lib3ds_mesh_indexed_new(Lib3dsMesh *mesh, int nthreads) {
+    Lib3dsMeshIndexed *indexed;
+    float (*normals)[3];
+    int *head, *next, *corner;
+    int i, n = 0;
+
+    assert(mesh);
+    if ((mesh->nvertices && !mesh->vertices) || (mesh->nfaces && !mesh->faces)) {
+        return NULL;
+    }
+    indexed = (Lib3dsMeshIndexed*)lib3ds_util_heap_calloc(sizeof(Lib3dsMeshIndexed));
+    indexed->nfaces = mesh->nfaces;
+    if (!mesh->nfaces) {
+        return indexed;
+    }
+
+    normals = (float(*)[3])lib3ds_util_heap_malloc(sizeof(float) * 9 * mesh->nfaces);
+    lib3ds_mesh_calculate_vertex_normals_parallel(mesh, normals, nthreads);
+
+    /* head[v] is the first vertex created from mesh vertex v, next[] 
+       chains the others and corner[] is the face corner that created
+       a vertex */
+    head = (int*)lib3ds_util_heap_malloc(sizeof(int) * mesh->nvertices);
+    next = (int*)lib3ds_util_heap_malloc(sizeof(int) * 6 * mesh->nfaces);
+    corner = next + 3 * mesh->nfaces;
+    indexed->indices = (unsigned*)lib3ds_util_heap_malloc(sizeof(unsigned) * 3 * mesh->nfaces);
+    for (i = 0; i < mesh->nvertices; ++i) {
+        head[i] = -1;
+    }
+    for (i = 0; i < 3 * mesh->nfaces; ++i) {
+        unsigned v = mesh->faces[i / 3].index[i % 3];
+        int *k;
+
+        assert(v < (unsigned)mesh->nvertices);
+        for (k = &head[v]; *k >= 0; k = &next[*k]) {
+            if (memcmp(normals[i], normals[corner[*k]], sizeof(float) * 3) == 0) {
+                break;
             }
         }
+        if (*k < 0) {
+            *k = n;
+            next[n] = -1;
+            corner[n] = i;
+            ++n;
+        }
+        indexed->indices[i] = *k;
     }
 
-    for (i = 0; i < mesh->nfaces; ++i) {
-        Lib3dsFace *f = &mesh->faces[i];
-        for (j = 0; j < 3; ++j) {
-            float n[3];
-            Lib3dsFaces *p;
-            Lib3dsFace *pf;
+    indexed->nvertices = n;
+    indexed->positions = (float(*)[3])lib3ds_util_heap_malloc(sizeof(float) * 3 * n);
+    indexed->texcos = mesh->texcos? (float(*)[2])lib3ds_util_heap_malloc(sizeof(float) * 2 * n) : NULL;
+    indexed->normals = (float(*)[3])lib3ds_util_heap_malloc(sizeof(float) * 3 * n);
+    indexed->source = (int*)lib3ds_util_heap_malloc(sizeof(int) * n);
+    for (i = 0; i < n; ++i) {
+        int v = mesh->faces[corner[i] / 3].index[corner[i] % 3];
+        lib3ds_vector_copy(indexed->positions[i], mesh->vertices[v]);
+        if (indexed->texcos) {
+            indexed->texcos[i][0] = mesh->texcos[v][0];
+            indexed->texcos[i][1] = mesh->texcos[v][1];
+        }
+        lib3ds_vector_copy(indexed->normals[i], normals[corner[i]]);
+        indexed->source[i] = v;
+    }
 
-            assert(mesh->faces[i].index[j] < mesh->nvertices);
+    lib3ds_util_heap_free(next);
+    lib3ds_util_heap_free(head);
+    lib3ds_util_heap_free(normals);
+    return indexed;
+}
 
-            if (f->smoothing_group) {
-                unsigned smoothing_group = f->smoothing_group;
 
-                lib3ds_vector_zero(n);
-                for (p = fl[mesh->faces[i].index[j]]; p; p = p->next) {
-                    pf = &mesh->faces[p->index];
-                    if (pf->smoothing_group & f->smoothing_group)
-                        smoothing_group |= pf->smoothing_group;
-                }
+void
+lib3ds_mesh_indexed_free(Lib3dsMeshIndexed *indexed) {
+    if (!indexed) {
+        return;
+    }
+    lib3ds_util_heap_free(indexed->positions);
+    lib3ds_util_heap_free(indexed->texcos);
+    lib3ds_util_heap_free(indexed->normals);
+    lib3ds_util_heap_free(indexed->source);
+    lib3ds_util_heap_free(indexed->indices);
+    lib3ds_util_heap_free(indexed);
+}
 
-                for (p = fl[mesh->faces[i].index[j]]; p; p = p->next) {
-                    pf = &mesh->faces[p->index];                
-                    if (smoothing_group & pf->smoothing_group) {
-                        lib3ds_vector_add(n, n, p->normal);
-                    }
-                }
-            } else {
-                lib3ds_vector_copy(n, fa[3*i+j].normal);
-            }
 
-            lib3ds_vector_normalize(n);
-            lib3ds_vector_copy(normals[3*i+j], n);
+/*!
+ * Creates a structure of arrays copy of the vertices and faces of a
+ * mesh. Kernels working on a single attribute, like the bounding box
+ * or the face normals, only touch the memory they need and the
+ * coordinate loops can be vectorized by the compiler. The copy is
+ * not updated when the mesh changes.
+ *
+ * \param mesh The mesh object.
+ *
+ * \return The new object, to be freed with lib3ds_mesh_soa_free(), or 
+ *         NULL if the mesh data is not loaded (see lib3ds_mesh_load()).
+ */
+Lib3dsMeshSoa*
+lib3ds_mesh_soa_new(Lib3dsMesh *mesh) {
+    Lib3dsMeshSoa *soa;
+    size_t align = LIB3DS_SOA_WIDTH * sizeof(float);
+    char *p;
+    int i;
+
+    assert(mesh);
+    if ((mesh->nvertices && !mesh->vertices) || (mesh->nfaces && !mesh->faces)) {
+        return NULL;
+    }
+    soa = (Lib3dsMeshSoa*)lib3ds_util_heap_calloc(sizeof(Lib3dsMeshSoa));
+    soa->nvertices = mesh->nvertices;
+    soa->capacity = (mesh->nvertices + LIB3DS_SOA_WIDTH - 1) & ~(LIB3DS_SOA_WIDTH - 1);
+    soa->nfaces = mesh->nfaces;
+    soa->data = lib3ds_util_heap_malloc(
+        align + 3 * soa->capacity * sizeof(float) + 5 * soa->nfaces * sizeof(unsigned)
+    );
+
+    p = (char*)soa->data + align - ((size_t)soa->data & (align - 1));
+    soa->x = (float*)p;
+    soa->y = soa->x + soa->capacity;
+    soa->z = soa->y + soa->capacity;
+    soa->indices = (unsigned*)(soa->z + soa->capacity);
+    soa->material = (int*)(soa->indices + 3 * soa->nfaces);
+    soa->smoothing_group = (unsigned*)(soa->material + soa->nfaces);
+
+    for (i = 0; i < soa->capacity; ++i) {
+        float *v = mesh->vertices[(i < mesh->nvertices)? i : mesh->nvertices - 1];
+        soa->x[i] = v[0];
+        soa->y[i] = v[1];
+        soa->z[i] = v[2];
+    }
+    for (i = 0; i < soa->nfaces; ++i) {
+        soa->indices[3*i] = mesh->faces[i].index[0];
+        soa->indices[3*i+1] = mesh->faces[i].index[1];
+        soa->indices[3*i+2] = mesh->faces[i].index[2];
+        soa->material[i] = mesh->faces[i].material;
+        soa->smoothing_group[i] = mesh->faces[i].smoothing_group;
+    }
+    return soa;
+}
+
+
+void
+lib3ds_mesh_soa_free(Lib3dsMeshSoa *soa) {
+    if (!soa) {
+        return;
+    }
+    lib3ds_util_heap_free(soa->data);
+    lib3ds_util_heap_free(soa);
+}
+
+
+/*!
+ * Copies the vertex positions of a structure of arrays copy back into 
+ * the mesh it was created from, e.g. after lib3ds_mesh_soa_transform().
+ */
+void
+lib3ds_mesh_soa_store(Lib3dsMeshSoa *soa, Lib3dsMesh *mesh) {
+    int i;
+
+    assert(soa && mesh);
+    assert(soa->nvertices == mesh->nvertices);
+    for (i = 0; i < soa->nvertices; ++i) {
+        mesh->vertices[i][0] = soa->x[i];
+        mesh->vertices[i][1] = soa->y[i];
+        mesh->vertices[i][2] = soa->z[i];
+    }
+}
+
+
+/*!
+ * Same as lib3ds_mesh_bounding_box() for a structure of arrays copy.
+ */
+void
+lib3ds_mesh_soa_bounding_box(Lib3dsMeshSoa *soa, float bmin[3], float bmax[3]) {
+    float lo[3][LIB3DS_SOA_WIDTH], hi[3][LIB3DS_SOA_WIDTH];
+    int i, j;
+
+    bmin[0] = bmin[1] = bmin[2] = FLT_MAX;
+    bmax[0] = bmax[1] = bmax[2] = -FLT_MAX;
+    if (!soa->nvertices) {
+        return;
+    }
+
+    /* one running minimum and maximum per lane, the padding repeats 
+       the last vertex and does not change the result */
+    for (j = 0; j < LIB3DS_SOA_WIDTH; ++j) {
+        lo[0][j] = lo[1][j] = lo[2][j] = FLT_MAX;
+        hi[0][j] = hi[1][j] = hi[2][j] = -FLT_MAX;
+    }
+    for (i = 0; i < soa->capacity; i += LIB3DS_SOA_WIDTH) {
+        for (j = 0; j < LIB3DS_SOA_WIDTH; ++j) {
+            float x = soa->x[i + j], y = soa->y[i + j], z = soa->z[i + j];
+            lo[0][j] = (x < lo[0][j])? x : lo[0][j];
+            lo[1][j] = (y < lo[1][j])? y : lo[1][j];
+            lo[2][j] = (z < lo[2][j])? z : lo[2][j];
+            hi[0][j] = (x > hi[0][j])? x : hi[0][j];
+            hi[1][j] = (y > hi[1][j])? y : hi[1][j];
+            hi[2][j] = (z > hi[2][j])? z : hi[2][j];
         }
     }
+    for (i = 0; i < 3; ++i) {
+        for (j = 0; j < LIB3DS_SOA_WIDTH; ++j) {
+            if (lo[i][j] < bmin[i]) {
+                bmin[i] = lo[i][j];
+            }
+            if (hi[i][j] > bmax[i]) {
+                bmax[i] = hi[i][j];
+            }
+        }
+    }
+}
 
-    free(fa);
-    free(fl);
+
+/*!
+ * Same as lib3ds_mesh_calculate_face_normals() for a structure of 
+ * arrays copy, with identical results.
+ *
+ * \param soa The structure of arrays copy of a mesh.
+ * \param nx  Buffer of soa->nfaces floats for the x components.
+ * \param ny  Buffer of soa->nfaces floats for the y components.
+ * \param nz  Buffer of soa->nfaces floats for the z components.
+ */
+void
+lib3ds_mesh_soa_calculate_face_normals(Lib3dsMeshSoa *soa, float *nx, float *ny, float *nz) {
+    const float *x = soa->x, *y = soa->y, *z = soa->z;
+    int i;
+
+    /* unnormalized cross products first, the loop has no branches */
+    for (i = 0; i < soa->nfaces; ++i) {
+        unsigned a = soa->indices[3*i], b = soa->indices[3*i+1], c = soa->indices[3*i+2];
+        float px = x[c] - x[b], py = y[c] - y[b], pz = z[c] - z[b];
+        float qx = x[a] - x[b], qy = y[a] - y[b], qz = z[a] - z[b];
+        nx[i] = py * qz - pz * qy;
+        ny[i] = pz * qx - px * qz;
+        nz[i] = px * qy - py * qx;
+    }
+    for (i = 0; i < soa->nfaces; ++i) {
+        float n[3];
+        n[0] = nx[i];
+        n[1] = ny[i];
+        n[2] = nz[i];
+        lib3ds_vector_normalize(n);
+        nx[i] = n[0];
+        ny[i] = n[1];
+        nz[i] = n[2];
+    }
+}
+
+
+/*!
+ * Multiplies all vertices of a structure of arrays copy by a 
+ * transformation matrix, see lib3ds_vector_transform().
+ */
+void
+lib3ds_mesh_soa_transform(Lib3dsMeshSoa *soa, float matrix[4][4]) {
+    float m[4][4];
+    int i;
+
+    memcpy(m, matrix, sizeof(m));
+    for (i = 0; i < soa->capacity; ++i) {
+        float x = soa->x[i], y = soa->y[i], z = soa->z[i];
+        soa->x[i] = m[0][0] * x + m[1][0] * y + m[2][0] * z + m[3][0];
+        soa->y[i] = m[0][1] * x + m[1][1] * y + m[2][1] * z + m[3][1];
+        soa->z[i] = m[0][2] * x + m[1][2] * y + m[2][2] * z + m[3][2];
+    }
 }
 
 
@@ -240,18 +706,27 @@ face_array_read(Lib3dsFile *file, Lib3dsMesh *mesh, Lib3dsIo *io) {
     uint16_t chunk;
     int i;
     uint16_t nfaces;
+    Lib3dsIoImpl *impl = (Lib3dsIoImpl*)io->impl;
 
     lib3ds_chunk_read_start(&c, CHK_FACE_ARRAY, io);
 
     lib3ds_mesh_resize_faces(mesh, 0);
     nfaces = lib3ds_io_read_word(io);
     if (nfaces) {
+        /* Scratch buffer large enough for the face array, the
+           smoothing groups and any material group. */
+        uint32_t *buffer = (uint32_t*)lib3ds_util_heap_malloc(4 * sizeof(uint16_t) * nfaces);
+        uint16_t *w = (uint16_t*)buffer;
+        impl->tmp_mem = buffer;
+        assert(buffer);
+
         lib3ds_mesh_resize_faces(mesh, nfaces);
-        for (i = 0; i < nfaces; ++i) {
-            mesh->faces[i].index[0] = lib3ds_io_read_word(io);
-            mesh->faces[i].index[1] = lib3ds_io_read_word(io);
-            mesh->faces[i].index[2] = lib3ds_io_read_word(io);
-            mesh->faces[i].flags = lib3ds_io_read_word(io);
+        lib3ds_io_read_words(io, w, 4 * nfaces);
+        for (i = 0; i < nfaces; ++i, w += 4) {
+            mesh->faces[i].index[0] = w[0];
+            mesh->faces[i].index[1] = w[1];
+            mesh->faces[i].index[2] = w[2];
+            mesh->faces[i].flags = w[3];
         }
         lib3ds_chunk_read_tell(&c, io);
 
@@ -261,17 +736,25 @@ face_array_read(Lib3dsFile *file, Lib3dsMesh *mesh, Lib3dsIo *io) {
                     char name[64];
                     unsigned n;
                     unsigned i;
-                    int index;
                     int material;
 
                     lib3ds_io_read_string(io, name, 64);
                     material = lib3ds_file_material_by_name(file, name);
 
                     n = lib3ds_io_read_word(io);
+                    w = (uint16_t*)buffer;
+                    if (n > 2u * nfaces) {
+                        /* more entries than faces, grow scratch buffer */
+                        impl->tmp_mem = NULL;
+                        lib3ds_util_heap_free(buffer);
+                        buffer = (uint32_t*)lib3ds_util_heap_malloc(sizeof(uint16_t) * n);
+                        impl->tmp_mem = buffer;
+                        w = (uint16_t*)buffer;
+                    }
+                    lib3ds_io_read_words(io, w, n);
                     for (i = 0; i < n; ++i) {
-                        index = lib3ds_io_read_word(io);
-                        if (index < mesh->nfaces) {
-                            mesh->faces[index].material = material;
+                        if (w[i] < mesh->nfaces) {
+                            mesh->faces[w[i]].material = material;
                         } else {
                             // TODO warning
                         }
@@ -281,8 +764,9 @@ face_array_read(Lib3dsFile *file, Lib3dsMesh *mesh, Lib3dsIo *io) {
 
                 case CHK_SMOOTH_GROUP: {
                     int i;
+                    lib3ds_io_read_dwords(io, buffer, mesh->nfaces);
                     for (i = 0; i < mesh->nfaces; ++i) {
-                        mesh->faces[i].smoothing_group = lib3ds_io_read_dword(io);
+                        mesh->faces[i].smoothing_group = buffer[i];
                     }
                     break;
                 }
@@ -302,6 +786,8 @@ face_array_read(Lib3dsFile *file, Lib3dsMesh *mesh, Lib3dsIo *io) {
             }
         }
 
+        impl->tmp_mem = NULL;
+        lib3ds_util_heap_free(buffer);
     }
     lib3ds_chunk_read_end(&c, io);
 }
@@ -311,19 +797,22 @@ void
 lib3ds_mesh_read(Lib3dsFile *file, Lib3dsMesh *mesh, Lib3dsIo *io) {
     Lib3dsChunk c;
     uint16_t chunk;
+    int lazy = (io->flags & LIB3DS_IO_LAZY_MESHES) != 0;
 
     lib3ds_chunk_read_start(&c, CHK_N_TRI_OBJECT, io);
+    if (lazy) {
+        /* only the counts are read, lib3ds_mesh_load reads the geometry */
+        mesh->data_offset = c.end - c.size;
+    }
 
     while ((chunk = lib3ds_chunk_read_next(&c, io)) != 0) {
         switch (chunk) {
             case CHK_MESH_MATRIX: {
-                int i, j;
+                int i;
 
                 lib3ds_matrix_identity(mesh->matrix);
                 for (i = 0; i < 4; i++) {
-                    for (j = 0; j < 3; j++) {
-                        mesh->matrix[i][j] = lib3ds_io_read_float(io);
-                    }
+                    lib3ds_io_read_floats(io, mesh->matrix[i], 3);
                 }
                 break;
             }
@@ -334,27 +823,33 @@ lib3ds_mesh_read(Lib3dsFile *file, Lib3dsMesh *mesh, Lib3dsIo *io) {
             }
 
             case CHK_POINT_ARRAY: {
-                int i;
                 uint16_t nvertices = lib3ds_io_read_word(io);
-                lib3ds_mesh_resize_vertices(mesh, nvertices, mesh->texcos != NULL, mesh->vflags != NULL);
-                for (i = 0; i < mesh->nvertices; ++i) {
-                    lib3ds_io_read_vector(io, mesh->vertices[i]);
+                if (lazy) {
+                    mesh->nvertices = nvertices;
+                    break;
                 }
+                lib3ds_mesh_resize_vertices(mesh, nvertices, mesh->texcos != NULL, mesh->vflags != NULL);
+                lib3ds_io_read_floats(io, (float*)mesh->vertices, 3 * mesh->nvertices);
                 break;
             }
 
             case CHK_POINT_FLAG_ARRAY: {
-                int i;
-                uint16_t nflags = lib3ds_io_read_word(io);
-                uint16_t nvertices = (mesh->nvertices >= nflags)? mesh->nvertices : nflags;
-                lib3ds_mesh_resize_vertices(mesh, nvertices, mesh->texcos != NULL, 1);
-                for (i = 0; i < nflags; ++i) {
-                    mesh->vflags[i] = lib3ds_io_read_word(io);
+                uint16_t nflags, nvertices;
+                if (lazy) {
+                    break;
                 }
+                nflags = lib3ds_io_read_word(io);
+                nvertices = (mesh->nvertices >= nflags)? mesh->nvertices : nflags;
+                lib3ds_mesh_resize_vertices(mesh, nvertices, mesh->texcos != NULL, 1);
+                lib3ds_io_read_words(io, mesh->vflags, nflags);
                 break;
             }
 
             case CHK_FACE_ARRAY: {
+                if (lazy) {
+                    mesh->nfaces = lib3ds_io_read_word(io);
+                    break;
+                }
                 lib3ds_chunk_read_reset(&c, io);
                 face_array_read(file, mesh, io);
                 break;
@@ -387,16 +882,16 @@ lib3ds_mesh_read(Lib3dsFile *file, Lib3dsMesh *mesh, Lib3dsIo *io) {
             }
 
             case CHK_TEX_VERTS: {
-                int i;
-                uint16_t ntexcos = lib3ds_io_read_word(io);
-                uint16_t nvertices = (mesh->nvertices >= ntexcos)? mesh->nvertices : ntexcos;;
-                if (!mesh->texcos) {
-                    lib3ds_mesh_resize_vertices(mesh, nvertices, 1, mesh->vflags != NULL);
+                uint16_t ntexcos, nvertices;
+                if (lazy) {
+                    break;
                 }
-                for (i = 0; i < ntexcos; ++i) {
-                    mesh->texcos[i][0] = lib3ds_io_read_float(io);
-                    mesh->texcos[i][1] = lib3ds_io_read_float(io);
+                ntexcos = lib3ds_io_read_word(io);
+                nvertices = (mesh->nvertices >= ntexcos)? mesh->nvertices : ntexcos;
+                if (!mesh->texcos || (nvertices > mesh->nvertices)) {
+                    lib3ds_mesh_resize_vertices(mesh, nvertices, 1, mesh->vflags != NULL);
                 }
+                lib3ds_io_read_floats(io, (float*)mesh->texcos, 2 * ntexcos);
                 break;
             }
 
@@ -405,7 +900,7 @@ lib3ds_mesh_read(Lib3dsFile *file, Lib3dsMesh *mesh, Lib3dsIo *io) {
         }
     }
 
-    if (lib3ds_matrix_det(mesh->matrix) < 0.0) {
+    if (!lazy && (lib3ds_matrix_det(mesh->matrix) < 0.0)) {
         /* Flip X coordinate of vertices if mesh matrix
            has negative determinant */
         float inv_matrix[4][4], M[4][4];
@@ -499,9 +994,9 @@ face_array_write(Lib3dsFile *file, Lib3dsMesh *mesh, Lib3dsIo *io) {
 
         lib3ds_io_write_word(io, (uint16_t) mesh->nfaces);
         for (i = 0; i < mesh->nfaces; ++i) {
-            lib3ds_io_write_word(io, mesh->faces[i].index[0]);
-            lib3ds_io_write_word(io, mesh->faces[i].index[1]);
-            lib3ds_io_write_word(io, mesh->faces[i].index[2]);
+            lib3ds_io_write_word(io, (uint16_t)mesh->faces[i].index[0]);
+            lib3ds_io_write_word(io, (uint16_t)mesh->faces[i].index[1]);
+            lib3ds_io_write_word(io, (uint16_t)mesh->faces[i].index[2]);
             lib3ds_io_write_word(io, mesh->faces[i].flags);
         }
     }
@@ -509,40 +1004,57 @@ face_array_write(Lib3dsFile *file, Lib3dsMesh *mesh, Lib3dsIo *io) {
     {
         /*---- MSH_CHK_MAT_GROUP ----*/
         Lib3dsChunk c;
-        int i, j;
-        uint16_t num;
+        int i, j, m;
         Lib3dsIoImpl *impl = (Lib3dsIoImpl*)io->impl;
+        int *first, *faces;
 
-        char *matf = (char*)calloc(sizeof(char), mesh->nfaces);
-        impl->tmp_mem = matf;
-        assert(matf);
+        /* counting sort of the faces by material, first[m] .. first[m + 1] - 1
+           are the faces of material m in ascending order */
+        first = (int*)lib3ds_util_heap_calloc(sizeof(int) * (file->nmaterials + 1 + mesh->nfaces));
+        faces = first + file->nmaterials + 1;
+        impl->tmp_mem = first;
 
         for (i = 0; i < mesh->nfaces; ++i) {
-            if (!matf[i] && (mesh->faces[i].material >= 0) && (mesh->faces[i].material < file->nmaterials)) {
-                matf[i] = 1;
-                num = 1;
+            m = mesh->faces[i].material;
+            if ((m >= 0) && (m < file->nmaterials)) {
+                ++first[m + 1];
+            }
+        }
+        for (m = 0; m < file->nmaterials; ++m) {
+            first[m + 1] += first[m];
+        }
+        for (i = 0; i < mesh->nfaces; ++i) {
+            m = mesh->faces[i].material;
+            if ((m >= 0) && (m < file->nmaterials)) {
+                faces[first[m]++] = i;
+            }
+        }
+        for (m = file->nmaterials; m > 0; --m) {
+            first[m] = first[m - 1];
+        }
+        first[0] = 0;
 
-                for (j = i + 1; j < mesh->nfaces; ++j) {
-                    if (mesh->faces[i].material == mesh->faces[j].material) ++num;
-                }
+        /* groups in the order of their first face */
+        for (i = 0; i < mesh->nfaces; ++i) {
+            uint16_t num;
 
-                c.chunk = CHK_MSH_MAT_GROUP;
-                c.size = 6 + (uint32_t)strlen(file->materials[mesh->faces[i].material]->name) + 1 + 2 + 2 * num;
-                lib3ds_chunk_write(&c, io);
-                lib3ds_io_write_string(io, file->materials[mesh->faces[i].material]->name);
-                lib3ds_io_write_word(io, num);
-                lib3ds_io_write_word(io, (uint16_t) i);
-
-                for (j = i + 1; j < mesh->nfaces; ++j) {
-                    if (mesh->faces[i].material == mesh->faces[j].material) {
-                        lib3ds_io_write_word(io, (uint16_t) j);
-                        matf[j] = 1;
-                    }
-                }
+            m = mesh->faces[i].material;
+            if ((m < 0) || (m >= file->nmaterials) || (faces[first[m]] != i)) {
+                continue;
+            }
+            num = (uint16_t)(first[m + 1] - first[m]);
+
+            c.chunk = CHK_MSH_MAT_GROUP;
+            c.size = 6 + (uint32_t)strlen(file->materials[m]->name) + 1 + 2 + 2 * num;
+            lib3ds_chunk_write(&c, io);
+            lib3ds_io_write_string(io, file->materials[m]->name);
+            lib3ds_io_write_word(io, num);
+            for (j = first[m]; j < first[m + 1]; ++j) {
+                lib3ds_io_write_word(io, (uint16_t)faces[j]);
             }
         }
         impl->tmp_mem = NULL;
-        free(matf);
+        lib3ds_util_heap_free(first);
     }
 
     {
@@ -601,7 +1113,7 @@ texco_array_write(Lib3dsMesh *mesh, Lib3dsIo *io) {
     c.size = 8 + 8 * mesh->nvertices;
     lib3ds_chunk_write(&c, io);
 
-    lib3ds_io_write_word(io, mesh->nvertices);
+    lib3ds_io_write_word(io, (uint16_t)mesh->nvertices);
     for (i = 0; i < mesh->nvertices; ++i) {
         lib3ds_io_write_float(io, mesh->texcos[i][0]);
         lib3ds_io_write_float(io, mesh->texcos[i][1]);
@@ -609,10 +1121,214 @@ texco_array_write(Lib3dsMesh *mesh, Lib3dsIo *io) {
 }
 
 
+/*!
+ * Builds the name of a part of a split mesh, the first part keeps the
+ * name of the mesh and the others are numbered "name#1", "name#2", ...
+ */
+void
+lib3ds_mesh_part_name(char name[64], const char *base, int part) {
+    char suffix[16];
+    size_t n;
+
+    n = strlen(base);
+    if (!part) {
+        memcpy(name, base, n + 1);
+        return;
+    }
+    sprintf(suffix, "#%d", part);
+    if (n + strlen(suffix) > 63) {
+        n = 63 - strlen(suffix);
+    }
+    memcpy(name, base, n);
+    strcpy(name + n, suffix);
+}
+
+
+struct Lib3dsMeshSplit {
+    Lib3dsMesh *mesh;
+    Lib3dsMesh *part;
+    int *stamp;         /* part + 1 a vertex was last added to, 0 if none */
+    int *local;         /* index of a vertex within its part */
+    int *vertices;      /* vertices of the current part */
+    int face;           /* next face to be distributed */
+    int vertex;         /* next vertex checked for being unreferenced */
+    int npart;
+};
+
+
+/*!
+ * Prepares splitting a mesh with more than 65535 vertices or faces 
+ * into parts which fit into a N_TRI_OBJECT chunk.
+ */
+Lib3dsMeshSplit*
+lib3ds_mesh_split_new(Lib3dsMesh *mesh) {
+    Lib3dsMeshSplit *split;
+
+    assert(mesh);
+    split = (Lib3dsMeshSplit*)lib3ds_util_heap_calloc(sizeof(Lib3dsMeshSplit));
+    split->mesh = mesh;
+    split->stamp = (int*)lib3ds_util_heap_calloc((2 * mesh->nvertices + LIB3DS_MESH_MAX_SIZE) * sizeof(int));
+    split->local = split->stamp + mesh->nvertices;
+    split->vertices = split->local + mesh->nvertices;
+    return split;
+}
+
+
+/* Distributes the faces and vertices of the next part, returns the 
+   number of its vertices or -1 if everything was distributed. Faces 
+   keep their order and are added to a part until it runs out of 
+   vertices, vertices used by faces of several parts are duplicated. 
+   Vertices not used by any face are appended at the end. */
+static int
+split_advance(Lib3dsMeshSplit *split) {
+    Lib3dsMesh *mesh = split->mesh;
+    int first = split->face;
+    int nvertices = 0;
+    int stamp, j;
+
+    if (split->face >= mesh->nfaces) {
+        while ((split->vertex < mesh->nvertices) && split->stamp[split->vertex]) {
+            ++split->vertex;
+        }
+        if (split->vertex >= mesh->nvertices) {
+            return -1;
+        }
+    }
+
+    stamp = ++split->npart;
+    while ((split->face < mesh->nfaces) && (split->face - first < LIB3DS_MESH_MAX_SIZE)) {
+        unsigned *index = mesh->faces[split->face].index;
+        int n = 0;
+        for (j = 0; j < 3; ++j) {
+            assert(index[j] < (unsigned)mesh->nvertices);
+            if (split->stamp[index[j]] != stamp) {
+                ++n;
+            }
+        }
+        if (nvertices + n > LIB3DS_MESH_MAX_SIZE) {
+            break;
+        }
+        for (j = 0; j < 3; ++j) {
+            if (split->stamp[index[j]] != stamp) {
+                split->stamp[index[j]] = stamp;
+                split->local[index[j]] = nvertices;
+                split->vertices[nvertices++] = index[j];
+            }
+        }
+        ++split->face;
+    }
+    if (split->face >= mesh->nfaces) {
+        for (; (split->vertex < mesh->nvertices) && (nvertices < LIB3DS_MESH_MAX_SIZE); ++split->vertex) {
+            if (!split->stamp[split->vertex]) {
+                split->stamp[split->vertex] = stamp;
+                split->vertices[nvertices++] = split->vertex;
+            }
+        }
+    }
+    return nvertices;
+}
+
+
+/*!
+ * Returns the next part of a mesh, NULL if all faces and vertices were
+ * distributed, see split_advance(). The part is owned by split and 
+ * valid until the next call.
+ */
+Lib3dsMesh*
+lib3ds_mesh_split_next(Lib3dsMeshSplit *split) {
+    Lib3dsMesh *mesh = split->mesh;
+    Lib3dsMesh *part;
+    int first = split->face;
+    int nvertices;
+    int i, j;
+    char name[64];
+
+    if (split->part) {
+        lib3ds_mesh_free(split->part);
+        split->part = NULL;
+    }
+    nvertices = split_advance(split);
+    if (nvertices < 0) {
+        return NULL;
+    }
+
+    lib3ds_mesh_part_name(name, mesh->name, split->npart - 1);
+    part = lib3ds_mesh_new(name);
+    memcpy(part, mesh, sizeof(Lib3dsMesh));
+    strcpy(part->name, name);
+    part->nvertices = part->nfaces = 0;
+    part->vertices = NULL;
+    part->texcos = NULL;
+    part->vflags = NULL;
+    part->faces = NULL;
+    part->data_offset = 0;
+
+    lib3ds_mesh_resize_vertices(part, nvertices, mesh->texcos != NULL, mesh->vflags != NULL);
+    for (i = 0; i < nvertices; ++i) {
+        int v = split->vertices[i];
+        lib3ds_vector_copy(part->vertices[i], mesh->vertices[v]);
+        if (mesh->texcos) {
+            part->texcos[i][0] = mesh->texcos[v][0];
+            part->texcos[i][1] = mesh->texcos[v][1];
+        }
+        if (mesh->vflags) {
+            part->vflags[i] = mesh->vflags[v];
+        }
+    }
+    lib3ds_mesh_resize_faces(part, split->face - first);
+    for (i = 0; i < part->nfaces; ++i) {
+        part->faces[i] = mesh->faces[first + i];
+        for (j = 0; j < 3; ++j) {
+            part->faces[i].index[j] = split->local[part->faces[i].index[j]];
+        }
+    }
+
+    split->part = part;
+    return part;
+}
+
+
+/*!
+ * Returns the number of parts lib3ds_mesh_split_next() divides a mesh 
+ * into.
+ */
+int
+lib3ds_mesh_split_count(Lib3dsMesh *mesh) {
+    Lib3dsMeshSplit *split = lib3ds_mesh_split_new(mesh);
+    int n = 0;
+
+    while (split_advance(split) >= 0) {
+        ++n;
+    }
+    lib3ds_mesh_split_free(split);
+    return n;
+}
+
+
+void
+lib3ds_mesh_split_free(Lib3dsMeshSplit *split) {
+    assert(split);
+    if (split->part) {
+        lib3ds_mesh_free(split->part);
+    }
+    lib3ds_util_heap_free(split->stamp);
+    lib3ds_util_heap_free(split);
+}
+
+
 void
 lib3ds_mesh_write(Lib3dsFile *file, Lib3dsMesh *mesh, Lib3dsIo *io) {
     Lib3dsChunk c;
 
+    if ((mesh->nvertices && !mesh->vertices) || (mesh->nfaces && !mesh->faces)) {
+        lib3ds_io_log(io, LIB3DS_LOG_ERROR, "Mesh data of %s not loaded.", mesh->name);
+        return;
+    }
+    if ((mesh->nvertices > LIB3DS_MESH_MAX_SIZE) || (mesh->nfaces > LIB3DS_MESH_MAX_SIZE)) {
+        lib3ds_io_log(io, LIB3DS_LOG_ERROR, "Mesh %s has more than 65535 vertices or faces.", mesh->name);
+        return;
+    }
+
     c.chunk = CHK_N_TRI_OBJECT;
     lib3ds_chunk_write_start(&c, io);
 
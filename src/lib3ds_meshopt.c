@@ -0,0 +1,818 @@
+/*
+    Copyright (C) 1996-2008 by Jan Eric Kyprianidis <www.kyprianidis.com>
+    All rights reserved.
+
+    This program is free  software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation, either version 2.1 of the License, or
+    (at your option) any later version.
+
+    Thisprogram  is  distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should  have received a copy of the GNU Lesser General Public License
+    along with  this program; If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "lib3ds_impl.h"
+
+
+#define LIB3DS_CACHE_MAX 64
+#define LIB3DS_VALENCE_MAX 32
+
+
+static int
+mesh_loaded(Lib3dsMesh *mesh) {
+    return (!mesh->nvertices || mesh->vertices) && (!mesh->nfaces || mesh->faces);
+}
+
+
+/*!
+ * Computes the average cache miss ratio (ACMR) of a mesh, the number of
+ * vertices transformed per face by a FIFO post-transform vertex cache.
+ * Values range from 3 for no reuse at all down to about 0.5 for large
+ * regular meshes.
+ *
+ * \param mesh       The mesh object.
+ * \param cache_size Number of vertices in the simulated cache.
+ */
+float
+lib3ds_mesh_calculate_acmr(Lib3dsMesh *mesh, int cache_size) {
+    int *timestamp;
+    int i, j, time = cache_size + 1, misses = 0;
+
+    assert(mesh && (cache_size > 0));
+    if (!mesh->nfaces || !mesh_loaded(mesh)) {
+        return 0.0f;
+    }
+    timestamp = (int*)lib3ds_util_heap_calloc(sizeof(int) * mesh->nvertices);
+    for (i = 0; i < mesh->nfaces; ++i) {
+        for (j = 0; j < 3; ++j) {
+            unsigned v = mesh->faces[i].index[j];
+            assert(v < (unsigned)mesh->nvertices);
+            if (time - timestamp[v] > cache_size) {
+                timestamp[v] = time++;
+                ++misses;
+            }
+        }
+    }
+    lib3ds_util_heap_free(timestamp);
+    return (float)misses / mesh->nfaces;
+}
+
+
+/* Faces reordered in place by a permutation, order[i] is the old index
+   of the face moved to position i. */
+static void
+permute_faces(Lib3dsMesh *mesh, const int *order) {
+    Lib3dsFace *faces = (Lib3dsFace*)lib3ds_util_heap_malloc(sizeof(Lib3dsFace) * mesh->nfaces);
+    int i;
+
+    memcpy(faces, mesh->faces, sizeof(Lib3dsFace) * mesh->nfaces);
+    for (i = 0; i < mesh->nfaces; ++i) {
+        mesh->faces[i] = faces[order[i]];
+    }
+    lib3ds_util_heap_free(faces);
+}
+
+
+/* Stable counting sort of the faces by material, in the order the
+   materials are first used. Fills order and returns the number of
+   groups, group[g] .. group[g + 1] - 1 being the positions of group g. */
+static int
+material_groups(Lib3dsMesh *mesh, int *order, int **group) {
+    int *ordinal = (int*)lib3ds_util_heap_malloc(sizeof(int) * mesh->nfaces);
+    int *materials = NULL;
+    int i, g, ngroups = 0;
+
+    for (i = 0; i < mesh->nfaces; ++i) {
+        for (g = ngroups - 1; g >= 0; --g) {
+            if (materials[g] == mesh->faces[i].material) {
+                break;
+            }
+        }
+        if (g < 0) {
+            materials = (int*)lib3ds_util_heap_realloc(materials, sizeof(int) * (ngroups + 1));
+            materials[ngroups] = mesh->faces[i].material;
+            g = ngroups++;
+        }
+        ordinal[i] = g;
+    }
+
+    *group = (int*)lib3ds_util_heap_calloc(sizeof(int) * (ngroups + 1));
+    for (i = 0; i < mesh->nfaces; ++i) {
+        ++(*group)[ordinal[i] + 1];
+    }
+    for (g = 0; g < ngroups; ++g) {
+        (*group)[g + 1] += (*group)[g];
+    }
+    for (i = 0; i < mesh->nfaces; ++i) {
+        order[(*group)[ordinal[i]]++] = i;
+    }
+    for (g = ngroups; g > 0; --g) {
+        (*group)[g] = (*group)[g - 1];
+    }
+    (*group)[0] = 0;
+
+    lib3ds_util_heap_free(materials);
+    lib3ds_util_heap_free(ordinal);
+    return ngroups;
+}
+
+
+typedef struct Lib3dsForsyth {
+    Lib3dsMesh *mesh;
+    int cache_size;
+    float position_score[LIB3DS_CACHE_MAX + 3];
+    float valence_score[LIB3DS_VALENCE_MAX];
+    int *valence;           /* remaining faces of each vertex */
+    int *first;             /* adjacency of each vertex, valid while it is used by the group */
+    int *position;          /* position of a vertex in the cache, -1 if not cached */
+    float *score;
+    int *adjacent;
+    float *face_score;      /* -1 once emitted */
+    int *touched;
+} Lib3dsForsyth;
+
+
+static float
+forsyth_score(Lib3dsForsyth *f, int v) {
+    int valence = f->valence[v];
+    float score;
+
+    if (!valence) {
+        return -1.0f;
+    }
+    score = (f->position[v] >= 0)? f->position_score[f->position[v]] : 0.0f;
+    if (valence < LIB3DS_VALENCE_MAX) {
+        score += f->valence_score[valence];
+    } else {
+        score += 2.0f * (float)pow(valence, -0.5);
+    }
+    return score;
+}
+
+
+/* Orders the faces order[0] .. order[n - 1] of one material group. */
+static void
+forsyth_group(Lib3dsForsyth *f, int *order, int n) {
+    Lib3dsFace *faces = f->mesh->faces;
+    int cache[LIB3DS_CACHE_MAX + 3], next_cache[LIB3DS_CACHE_MAX + 3];
+    int *result = (int*)lib3ds_util_heap_malloc(sizeof(int) * n);
+    int ntouched = 0, ncache = 0, scan = 0, best = -1;
+    int i, j, k;
+
+    /* adjacency of the used vertices, faces are referred to by their
+       position in order */
+    for (i = 0; i < n; ++i) {
+        for (j = 0; j < 3; ++j) {
+            unsigned v = faces[order[i]].index[j];
+            if (!f->valence[v]++) {
+                f->touched[ntouched++] = v;
+            }
+        }
+    }
+    for (i = 0, k = 0; i < ntouched; ++i) {
+        f->first[f->touched[i]] = k;
+        k += f->valence[f->touched[i]];
+        f->valence[f->touched[i]] = 0;
+    }
+    for (i = 0; i < n; ++i) {
+        for (j = 0; j < 3; ++j) {
+            unsigned v = faces[order[i]].index[j];
+            f->adjacent[f->first[v] + f->valence[v]++] = i;
+        }
+    }
+    for (i = 0; i < ntouched; ++i) {
+        f->score[f->touched[i]] = forsyth_score(f, f->touched[i]);
+    }
+    for (i = 0; i < n; ++i) {
+        unsigned *index = faces[order[i]].index;
+        f->face_score[i] = f->score[index[0]] + f->score[index[1]] + f->score[index[2]];
+    }
+
+    for (k = 0; k < n; ++k) {
+        int nnext = 0;
+        float best_score = -1.0f;
+
+        if (best < 0) {
+            while (f->face_score[scan] < 0) {
+                ++scan;
+            }
+            best = scan;
+        }
+        result[k] = order[best];
+        f->face_score[best] = -1.0f;
+
+        /* emitted face leaves the adjacency of its vertices, which move
+           to the front of the LRU cache */
+        for (j = 0; j < 3; ++j) {
+            unsigned v = faces[order[best]].index[j];
+            int *adjacent = f->adjacent + f->first[v];
+            for (i = 0; adjacent[i] != best; ++i);
+            adjacent[i] = adjacent[--f->valence[v]];
+            if (f->position[v] != -2) {
+                f->position[v] = -2;
+                next_cache[nnext++] = v;
+            }
+        }
+        for (i = 0; i < ncache; ++i) {
+            if (f->position[cache[i]] != -2) {
+                next_cache[nnext++] = cache[i];
+            }
+        }
+        for (i = 0; i < nnext; ++i) {
+            f->position[next_cache[i]] = (i < f->cache_size)? i : -1;
+        }
+        ncache = (nnext < f->cache_size)? nnext : f->cache_size;
+        memcpy(cache, next_cache, sizeof(int) * ncache);
+
+        /* rescore the cached vertices and the ones pushed out, the next
+           face is the best one using a cached vertex */
+        best = -1;
+        for (i = 0; i < nnext; ++i) {
+            f->score[next_cache[i]] = forsyth_score(f, next_cache[i]);
+        }
+        for (i = 0; i < nnext; ++i) {
+            unsigned v = next_cache[i];
+            int *adjacent = f->adjacent + f->first[v];
+            for (j = 0; j < f->valence[v]; ++j) {
+                unsigned *index = faces[order[adjacent[j]]].index;
+                float s = f->score[index[0]] + f->score[index[1]] + f->score[index[2]];
+                f->face_score[adjacent[j]] = s;
+                if (s > best_score) {
+                    best_score = s;
+                    best = adjacent[j];
+                }
+            }
+        }
+    }
+
+    memcpy(order, result, sizeof(int) * n);
+    for (i = 0; i < ntouched; ++i) {
+        f->position[f->touched[i]] = -1;
+        f->valence[f->touched[i]] = 0;
+    }
+    lib3ds_util_heap_free(result);
+}
+
+
+/*!
+ * Reorders the faces of a mesh for the post-transform vertex cache of
+ * the GPU, using Tom Forsyth's linear-speed vertex cache optimisation.
+ * Faces of the same material are kept together, the material groups
+ * appear in the order of their first face. Faces keep their material,
+ * smoothing group and flags, so the mesh is written the same way
+ * apart from the face order.
+ *
+ * \param mesh       The mesh object.
+ * \param cache_size Number of vertices in the simulated LRU cache,
+ *                   0 for the default of 32.
+ */
+void
+lib3ds_mesh_optimize_vertex_cache(Lib3dsMesh *mesh, int cache_size) {
+    Lib3dsForsyth f;
+    int *order, *group;
+    int i, ngroups;
+
+    assert(mesh);
+    if (!mesh->nfaces || !mesh_loaded(mesh)) {
+        return;
+    }
+    if (cache_size <= 0) {
+        cache_size = 32;
+    }
+    if (cache_size > LIB3DS_CACHE_MAX) {
+        cache_size = LIB3DS_CACHE_MAX;
+    }
+
+    memset(&f, 0, sizeof(f));
+    f.mesh = mesh;
+    f.cache_size = cache_size;
+    for (i = 0; i < cache_size; ++i) {
+        f.position_score[i] = (i < 3)? 0.75f : (float)pow(1.0f - (float)(i - 3) / (cache_size - 3), 1.5);
+    }
+    for (i = 1; i < LIB3DS_VALENCE_MAX; ++i) {
+        f.valence_score[i] = 2.0f * (float)pow(i, -0.5);
+    }
+    f.valence = (int*)lib3ds_util_heap_calloc(sizeof(int) * 4 * mesh->nvertices);
+    f.first = f.valence + mesh->nvertices;
+    f.position = f.first + mesh->nvertices;
+    f.touched = f.position + mesh->nvertices;
+    f.score = (float*)lib3ds_util_heap_malloc(sizeof(float) * mesh->nvertices);
+    f.adjacent = (int*)lib3ds_util_heap_malloc(sizeof(int) * 3 * mesh->nfaces);
+    f.face_score = (float*)lib3ds_util_heap_malloc(sizeof(float) * mesh->nfaces);
+    for (i = 0; i < mesh->nvertices; ++i) {
+        f.position[i] = -1;
+    }
+
+    order = (int*)lib3ds_util_heap_malloc(sizeof(int) * mesh->nfaces);
+    ngroups = material_groups(mesh, order, &group);
+    for (i = 0; i < ngroups; ++i) {
+        forsyth_group(&f, order + group[i], group[i + 1] - group[i]);
+    }
+    permute_faces(mesh, order);
+
+    lib3ds_util_heap_free(group);
+    lib3ds_util_heap_free(order);
+    lib3ds_util_heap_free(f.face_score);
+    lib3ds_util_heap_free(f.adjacent);
+    lib3ds_util_heap_free(f.score);
+    lib3ds_util_heap_free(f.valence);
+}
+
+
+typedef struct Lib3dsCluster {
+    int begin;
+    int end;
+    float key;
+} Lib3dsCluster;
+
+
+static int
+cluster_compare(const void *a, const void *b) {
+    const Lib3dsCluster *ca = (const Lib3dsCluster*)a;
+    const Lib3dsCluster *cb = (const Lib3dsCluster*)b;
+    if (ca->key != cb->key) {
+        return (ca->key > cb->key)? -1 : 1;
+    }
+    return ca->begin - cb->begin;
+}
+
+
+/*!
+ * Reorders clusters of faces of a mesh to reduce overdraw, following
+ * Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex
+ * Locality and Reduced Overdraw". The faces should already be ordered
+ * by lib3ds_mesh_optimize_vertex_cache(). They are cut into clusters
+ * where the cache starts over, or where the cache miss ratio of a
+ * cluster is within threshold times the one of the whole run. The
+ * clusters facing outwards the most are then drawn first. Consecutive
+ * runs of faces with the same material are sorted independently and
+ * stay in place.
+ *
+ * \param mesh       The mesh object.
+ * \param cache_size Number of vertices in the simulated FIFO cache,
+ *                   0 for the default of 32.
+ * \param threshold  Allowed increase of the cache miss ratio, e.g. 1.05.
+ */
+void
+lib3ds_mesh_optimize_overdraw(Lib3dsMesh *mesh, int cache_size, float threshold) {
+    Lib3dsCluster *clusters;
+    int *timestamp, *order;
+    int begin, end, i, j, n, time;
+
+    assert(mesh);
+    if (!mesh->nfaces || !mesh_loaded(mesh)) {
+        return;
+    }
+    if (cache_size <= 0) {
+        cache_size = 32;
+    }
+
+    timestamp = (int*)lib3ds_util_heap_calloc(sizeof(int) * mesh->nvertices);
+    clusters = (Lib3dsCluster*)lib3ds_util_heap_malloc(sizeof(Lib3dsCluster) * mesh->nfaces);
+    order = (int*)lib3ds_util_heap_malloc(sizeof(int) * mesh->nfaces);
+    time = cache_size + 1;
+    for (i = 0; i < mesh->nfaces; ++i) {
+        order[i] = i;
+    }
+
+    for (begin = 0; begin < mesh->nfaces; begin = end) {
+        float centroid[3], area = 0.0f, acmr;
+        int misses = 0, cluster_misses = 0, start;
+
+        for (end = begin; (end < mesh->nfaces) && (mesh->faces[end].material == mesh->faces[begin].material); ++end);
+
+        /* cache miss ratio of the run */
+        time += cache_size + 1;
+        for (i = begin; i < end; ++i) {
+            for (j = 0; j < 3; ++j) {
+                unsigned v = mesh->faces[i].index[j];
+                if (time - timestamp[v] > cache_size) {
+                    timestamp[v] = time++;
+                    ++misses;
+                }
+            }
+        }
+        acmr = (float)misses / (end - begin);
+
+        /* clusters, each one starting with an empty cache since they 
+           are drawn in a different order afterwards */
+        n = 0;
+        start = begin;
+        time += cache_size + 1;
+        for (i = begin; i < end; ++i) {
+            int face_misses = 0;
+            for (j = 0; j < 3; ++j) {
+                unsigned v = mesh->faces[i].index[j];
+                if (time - timestamp[v] > cache_size) {
+                    timestamp[v] = time++;
+                    ++face_misses;
+                }
+            }
+            if ((face_misses == 3) && (i > start)) {
+                /* hard boundary, the cache starts over anyway */
+                clusters[n].begin = start;
+                clusters[n].end = i;
+                ++n;
+                start = i;
+                cluster_misses = 0;
+            }
+            cluster_misses += face_misses;
+            if ((i + 1 < end) && ((float)cluster_misses / (i + 1 - start) <= threshold * acmr)) {
+                clusters[n].begin = start;
+                clusters[n].end = i + 1;
+                ++n;
+                start = i + 1;
+                cluster_misses = 0;
+                time += cache_size + 1;
+            }
+        }
+        clusters[n].begin = start;
+        clusters[n].end = end;
+        ++n;
+        if (n == 1) {
+            continue;
+        }
+
+        /* area weighted centroid of the run */
+        lib3ds_vector_zero(centroid);
+        for (i = begin; i < end; ++i) {
+            unsigned *index = mesh->faces[i].index;
+            float p[3], q[3], c[3], a;
+            lib3ds_vector_sub(p, mesh->vertices[index[1]], mesh->vertices[index[0]]);
+            lib3ds_vector_sub(q, mesh->vertices[index[2]], mesh->vertices[index[0]]);
+            lib3ds_vector_cross(c, p, q);
+            a = lib3ds_vector_length(c);
+            for (j = 0; j < 3; ++j) {
+                centroid[j] += a * (mesh->vertices[index[0]][j] + mesh->vertices[index[1]][j] + mesh->vertices[index[2]][j]) / 3.0f;
+            }
+            area += a;
+        }
+        if (area > 0.0f) {
+            lib3ds_vector_scalar_mul(centroid, centroid, 1.0f / area);
+        }
+
+        /* sort key is how far a cluster faces away from the centroid */
+        for (i = 0; i < n; ++i) {
+            float c[3], normal[3], d[3];
+            float a = 0.0f;
+
+            lib3ds_vector_zero(c);
+            lib3ds_vector_zero(normal);
+            for (j = clusters[i].begin; j < clusters[i].end; ++j) {
+                unsigned *index = mesh->faces[j].index;
+                float p[3], q[3], m[3], fa;
+                int k;
+                lib3ds_vector_sub(p, mesh->vertices[index[1]], mesh->vertices[index[0]]);
+                lib3ds_vector_sub(q, mesh->vertices[index[2]], mesh->vertices[index[0]]);
+                lib3ds_vector_cross(m, p, q);
+                fa = lib3ds_vector_length(m);
+                for (k = 0; k < 3; ++k) {
+                    c[k] += fa * (mesh->vertices[index[0]][k] + mesh->vertices[index[1]][k] + mesh->vertices[index[2]][k]) / 3.0f;
+                }
+                lib3ds_vector_add(normal, normal, m);
+                a += fa;
+            }
+            if (a > 0.0f) {
+                lib3ds_vector_scalar_mul(c, c, 1.0f / a);
+            }
+            lib3ds_vector_sub(d, c, centroid);
+            a = lib3ds_vector_length(normal);
+            clusters[i].key = (a > 0.0f)? lib3ds_vector_dot(d, normal) / a : 0.0f;
+        }
+        qsort(clusters, n, sizeof(Lib3dsCluster), cluster_compare);
+
+        for (i = 0, j = begin; i < n; ++i) {
+            int k;
+            for (k = clusters[i].begin; k < clusters[i].end; ++k) {
+                order[j++] = k;
+            }
+        }
+    }
+    permute_faces(mesh, order);
+
+    lib3ds_util_heap_free(order);
+    lib3ds_util_heap_free(clusters);
+    lib3ds_util_heap_free(timestamp);
+}
+
+
+/*!
+ * Renumbers the vertices of a mesh in the order they are first used by
+ * the faces, so the vertex fetch reads memory sequentially. Vertices
+ * not used by any face are moved to the end. Texture coordinates and
+ * vertex flags are reordered along with the vertices.
+ *
+ * \param mesh The mesh object.
+ */
+void
+lib3ds_mesh_optimize_vertex_fetch(Lib3dsMesh *mesh) {
+    int *remap, *order;
+    void *tmp;
+    int i, j, n = 0;
+
+    assert(mesh);
+    if (!mesh->nvertices || !mesh_loaded(mesh)) {
+        return;
+    }
+
+    remap = (int*)lib3ds_util_heap_malloc(sizeof(int) * 2 * mesh->nvertices);
+    order = remap + mesh->nvertices;
+    for (i = 0; i < mesh->nvertices; ++i) {
+        remap[i] = -1;
+    }
+    for (i = 0; i < mesh->nfaces; ++i) {
+        for (j = 0; j < 3; ++j) {
+            unsigned v = mesh->faces[i].index[j];
+            assert(v < (unsigned)mesh->nvertices);
+            if (remap[v] < 0) {
+                order[n] = v;
+                remap[v] = n++;
+            }
+            mesh->faces[i].index[j] = remap[v];
+        }
+    }
+    for (i = 0; i < mesh->nvertices; ++i) {
+        if (remap[i] < 0) {
+            order[n] = i;
+            remap[i] = n++;
+        }
+    }
+
+    tmp = lib3ds_util_heap_malloc(sizeof(float) * 3 * mesh->nvertices);
+    memcpy(tmp, mesh->vertices, sizeof(float) * 3 * mesh->nvertices);
+    for (i = 0; i < mesh->nvertices; ++i) {
+        lib3ds_vector_copy(mesh->vertices[i], ((float(*)[3])tmp)[order[i]]);
+    }
+    if (mesh->texcos) {
+        memcpy(tmp, mesh->texcos, sizeof(float) * 2 * mesh->nvertices);
+        for (i = 0; i < mesh->nvertices; ++i) {
+            mesh->texcos[i][0] = ((float(*)[2])tmp)[order[i]][0];
+            mesh->texcos[i][1] = ((float(*)[2])tmp)[order[i]][1];
+        }
+    }
+    if (mesh->vflags) {
+        memcpy(tmp, mesh->vflags, sizeof(unsigned short) * mesh->nvertices);
+        for (i = 0; i < mesh->nvertices; ++i) {
+            mesh->vflags[i] = ((unsigned short*)tmp)[order[i]];
+        }
+    }
+
+    lib3ds_util_heap_free(tmp);
+    lib3ds_util_heap_free(remap);
+}
+
+
+/*!
+ * Optimizes a mesh for rendering with the default settings, runs
+ * lib3ds_mesh_optimize_vertex_cache() and then
+ * lib3ds_mesh_optimize_vertex_fetch().
+ *
+ * \param mesh The mesh object.
+ */
+void
+lib3ds_mesh_optimize(Lib3dsMesh *mesh) {
+    lib3ds_mesh_optimize_vertex_cache(mesh, 0);
+    lib3ds_mesh_optimize_vertex_fetch(mesh);
+}
+
+
+/* Moves the high bits of x into the low bits used by the table, the 
+   bits of small integral values are zero at the bottom. */
+static uint32_t
+weld_mix(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x85ebca6bu;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35u;
+    x ^= x >> 16;
+    return x;
+}
+
+
+static unsigned
+weld_hash(unsigned x, unsigned y, unsigned z) {
+    return weld_mix(x) ^ (weld_mix(y) * 19349663u) ^ (weld_mix(z) * 83492791u);
+}
+
+
+/* Hashes the 64 bits of a grid coordinate, cells far from the origin
+   do not fit an int. */
+static unsigned
+weld_hash_coord(double c) {
+    uint32_t bits[2];
+    c += 0.0;   /* -0 and 0 */
+    memcpy(bits, &c, sizeof(bits));
+    return bits[0] ^ (bits[1] * 2654435761u);
+}
+
+
+static unsigned
+weld_hash_cell(double x, double y, double z) {
+    return weld_hash(weld_hash_coord(x), weld_hash_coord(y), weld_hash_coord(z));
+}
+
+
+static int
+weld_equal(Lib3dsMesh *mesh, int a, int b, float epsilon, unsigned flags) {
+    int i;
+
+    for (i = 0; i < 3; ++i) {
+        if (fabs((double)mesh->vertices[a][i] - mesh->vertices[b][i]) > epsilon) {
+            return FALSE;
+        }
+    }
+    if ((flags & LIB3DS_WELD_TEXCOS) && mesh->texcos) {
+        for (i = 0; i < 2; ++i) {
+            if (fabs((double)mesh->texcos[a][i] - mesh->texcos[b][i]) > epsilon) {
+                return FALSE;
+            }
+        }
+    }
+    if (mesh->vflags && (mesh->vflags[a] != mesh->vflags[b])) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+
+/* Removes degenerate faces and faces repeating an earlier one. Faces 
+   are compared with their indices rotated to start at the smallest, 
+   the kept faces themselves are not rotated. */
+static void
+weld_faces(Lib3dsMesh *mesh) {
+    int *head, *next;
+    unsigned (*keys)[3];
+    unsigned mask;
+    int i, n = 0;
+
+    for (mask = 1; mask < 2 * (unsigned)mesh->nfaces; mask <<= 1);
+    head = (int*)lib3ds_util_heap_malloc(sizeof(int) * mask);
+    next = (int*)lib3ds_util_heap_malloc(sizeof(int) * mesh->nfaces);
+    keys = (unsigned(*)[3])lib3ds_util_heap_malloc(sizeof(unsigned) * 3 * mesh->nfaces);
+    --mask;
+    for (i = 0; i <= (int)mask; ++i) {
+        head[i] = -1;
+    }
+
+    for (i = 0; i < mesh->nfaces; ++i) {
+        unsigned *index = mesh->faces[i].index;
+        unsigned *key = keys[n];
+        unsigned h;
+        int k;
+
+        if ((index[0] == index[1]) || (index[1] == index[2]) || (index[0] == index[2])) {
+            continue;
+        }
+        k = ((index[0] < index[1]) && (index[0] < index[2]))? 0 : (index[1] < index[2])? 1 : 2;
+        key[0] = index[k];
+        key[1] = index[(k + 1) % 3];
+        key[2] = index[(k + 2) % 3];
+        h = weld_hash(key[0], key[1], key[2]) & mask;
+        for (k = head[h]; k >= 0; k = next[k]) {
+            if ((keys[k][0] == key[0]) && (keys[k][1] == key[1]) && (keys[k][2] == key[2])) {
+                break;
+            }
+        }
+        if (k >= 0) {
+            continue;
+        }
+        mesh->faces[n] = mesh->faces[i];
+        next[n] = head[h];
+        head[h] = n;
+        ++n;
+    }
+
+    lib3ds_util_heap_free(keys);
+    lib3ds_util_heap_free(next);
+    lib3ds_util_heap_free(head);
+    lib3ds_mesh_resize_faces(mesh, n);
+}
+
+
+/*!
+ * Merges vertices of a mesh whose positions are within epsilon of each
+ * other, as left by exporters writing one vertex per face corner. The 
+ * vertices are looked up in a hash grid with cells of size 2*epsilon,
+ * so this takes expected linear time. Each vertex is merged into the
+ * first vertex it matches, the vertices keep their order. Vertices
+ * with different vertex flags are never merged.
+ *
+ * Afterwards faces using a vertex more than once and faces repeating
+ * the vertices of an earlier face with the same winding are removed,
+ * unless LIB3DS_WELD_KEEP_FACES is set. The remaining faces keep their 
+ * order, material and smoothing group.
+ *
+ * \param mesh    The mesh object.
+ * \param epsilon Largest difference of coordinates to be merged, 0 
+ *                merges identical vertices only.
+ * \param flags   Any of Lib3dsWeldFlags.
+ */
+void
+lib3ds_mesh_weld(Lib3dsMesh *mesh, float epsilon, unsigned flags) {
+    int *head, *next, *remap;
+    unsigned mask;
+    double scale;
+    int i, j, n = 0;
+
+    assert(mesh);
+    if (!mesh->nvertices || !mesh_loaded(mesh)) {
+        return;
+    }
+    if (epsilon < 0.0f) {
+        epsilon = 0.0f;
+    }
+    /* cells of 2*epsilon keep matches in neighbouring cells despite the
+       rounding of scale and of the products, in double both stay finite
+       for any float epsilon */
+    scale = (epsilon > 0.0f)? 0.5 / epsilon : 1.0;
+
+    for (mask = 1; mask < 2 * (unsigned)mesh->nvertices; mask <<= 1);
+    head = (int*)lib3ds_util_heap_malloc(sizeof(int) * mask);
+    next = (int*)lib3ds_util_heap_malloc(sizeof(int) * 2 * mesh->nvertices);
+    remap = next + mesh->nvertices;
+    --mask;
+    for (i = 0; i <= (int)mask; ++i) {
+        head[i] = -1;
+    }
+
+    /* only the vertices that are kept are entered in the grid, a match
+       within epsilon lies in the same or in a neighbouring cell */
+    for (i = 0; i < mesh->nvertices; ++i) {
+        unsigned h;
+        int found = -1;
+        if (epsilon > 0.0f) {
+            double c[3], d[3];
+            for (j = 0; j < 3; ++j) {
+                c[j] = floor((double)mesh->vertices[i][j] * scale);
+            }
+            h = weld_hash_cell(c[0], c[1], c[2]);
+            for (d[0] = -1; (d[0] <= 1) && (found < 0); ++d[0]) {
+                for (d[1] = -1; (d[1] <= 1) && (found < 0); ++d[1]) {
+                    for (d[2] = -1; (d[2] <= 1) && (found < 0); ++d[2]) {
+                        int k = head[weld_hash_cell(c[0] + d[0], c[1] + d[1], c[2] + d[2]) & mask];
+                        for (; k >= 0; k = next[k]) {
+                            if (weld_equal(mesh, remap[k], i, epsilon, flags)) {
+                                found = k;
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+        } else {
+            /* exact matches hash the coordinates themselves */
+            float p[3];
+            unsigned bits[3];
+            int k;
+            for (j = 0; j < 3; ++j) {
+                p[j] = mesh->vertices[i][j] + 0.0f;   /* -0 and 0 */
+            }
+            memcpy(bits, p, sizeof(bits));
+            h = weld_hash(bits[0], bits[1], bits[2]);
+            for (k = head[h & mask]; k >= 0; k = next[k]) {
+                if (weld_equal(mesh, remap[k], i, 0.0f, flags)) {
+                    found = k;
+                    break;
+                }
+            }
+        }
+        if (found >= 0) {
+            remap[i] = remap[found];
+            continue;
+        }
+        remap[i] = n;
+        if (n < i) {
+            lib3ds_vector_copy(mesh->vertices[n], mesh->vertices[i]);
+            if (mesh->texcos) {
+                mesh->texcos[n][0] = mesh->texcos[i][0];
+                mesh->texcos[n][1] = mesh->texcos[i][1];
+            }
+            if (mesh->vflags) {
+                mesh->vflags[n] = mesh->vflags[i];
+            }
+        }
+        /* the grid is chained by original index, the data of a kept
+           vertex is found at remap[] */
+        next[i] = head[h & mask];
+        head[h & mask] = i;
+        ++n;
+    }
+    lib3ds_util_heap_free(head);
+
+    for (i = 0; i < mesh->nfaces; ++i) {
+        for (j = 0; j < 3; ++j) {
+            assert(mesh->faces[i].index[j] < (unsigned)mesh->nvertices);
+            mesh->faces[i].index[j] = remap[mesh->faces[i].index[j]];
+        }
+    }
+    lib3ds_util_heap_free(next);
+    lib3ds_mesh_resize_vertices(mesh, n, mesh->texcos != NULL, mesh->vflags != NULL);
+
+    if (!(flags & LIB3DS_WELD_KEEP_FACES) && mesh->nfaces) {
+        weld_faces(mesh);
+    }
+}
@@ -20,7 +20,7 @@
 
 Lib3dsTrack* 
 lib3ds_track_new(Lib3dsTrackType type, int nkeys) {
-    Lib3dsTrack *track = (Lib3dsTrack*)calloc(sizeof(Lib3dsTrack), 1);
+    Lib3dsTrack *track = (Lib3dsTrack*)lib3ds_util_calloc(sizeof(Lib3dsTrack));
     track->type = type;
     lib3ds_track_resize(track, nkeys);
     return track;
@@ -32,23 +32,18 @@ lib3ds_track_free(Lib3dsTrack *track) {
     assert(track);
     lib3ds_track_resize(track, 0);
     memset(track, 0, sizeof(Lib3dsTrack));
-    free(track);
+    lib3ds_util_free(track);
 }
 
 
 void 
 lib3ds_track_resize(Lib3dsTrack *track, int nkeys) {
-    char *p;
-
     assert(track);
+    lib3ds_track_invalidate(track);
     if (track->nkeys == nkeys)
         return;
 
-    p = (char*)realloc(track->keys, sizeof(Lib3dsKey) * nkeys);
-    if (nkeys > track->nkeys) {
-        memset(p + (sizeof(Lib3dsKey)*track->nkeys), 0, sizeof(Lib3dsKey)*(nkeys - track->nkeys));
-    }
-    track->keys = (Lib3dsKey*)p;
+    track->keys = (Lib3dsKey*)lib3ds_util_realloc_array(track->keys, track->nkeys, nkeys, sizeof(Lib3dsKey));
     track->nkeys = nkeys;
 }
 
@@ -169,60 +164,50 @@ rot_key_setup(Lib3dsKey *prev, Lib3dsKey *cur, Lib3dsKey *next, float a[4], floa
 }
 
 
-static void
-quat_for_index(Lib3dsTrack *track, int index, float q[4]) {
-    float p[4];
-    int i;
-    lib3ds_quat_identity(q);
-    for (i = 0; i <= index; ++i) {
-        lib3ds_quat_axis_angle(p, track->keys[i].value, track->keys[i].value[3]);
-        lib3ds_quat_mul(q, p, q);
+/*!
+ * Releases the data derived from the keys of a track for evaluation.
+ * Has to be called after keys of a compiled track were changed in 
+ * place, the track is evaluated from the keys until it is compiled 
+ * again.
+ *
+ * \param track The track.
+ */
+void
+lib3ds_track_invalidate(Lib3dsTrack *track) {
+    assert(track);
+    if (track->cache) {
+        lib3ds_util_heap_free(track->cache->rotations);
+        lib3ds_util_heap_free(track->cache->segments);
+        lib3ds_util_heap_free(track->cache);
+        track->cache = NULL;
     }
 }
 
 
-static int 
-find_index(Lib3dsTrack *track, float t, float *u) {
+/*!
+ * Returns the absolute rotation of key index of a rotation track, from
+ * rotations if the track is compiled, otherwise by accumulating the 
+ * relative rotations of the keys up to index.
+ */
+static void
+track_rotation(Lib3dsTrack *track, float (*rotations)[4], int index, float q[4]) {
+    float p[4];
     int i;
-    float nt;
-    int t0, t1;
-
-    assert(track);
-    assert(track->nkeys > 0);
-    
-    if (track->nkeys <= 1)
-        return -1;
-    
-    t0 = track->keys[0].frame;
-    t1 = track->keys[track->nkeys-1].frame;
-    if (track->flags & LIB3DS_TRACK_REPEAT) {
-        nt = (float)fmod((float)(t - t0), (float)(t1 - t0)) + t0;
-    } else {
-        nt = t;
-    }
 
-    if (nt <= t0) {
-        return -1;
-    }
-    if (nt >= t1) {
-        return track->nkeys;
+    if (rotations) {
+        lib3ds_quat_copy(q, rotations[index]);
+        return;
     }
-
-    for (i = 1; i < track->nkeys; ++i) {
-        if (nt < track->keys[i].frame)
-            break;
+    lib3ds_quat_identity(q);
+    for (i = 0; i <= index; ++i) {
+        lib3ds_quat_axis_angle(p, track->keys[i].value, track->keys[i].value[3]);
+        lib3ds_quat_mul(q, p, q);
     }
-
-    *u = nt - (float)track->keys[i-1].frame;
-    *u /= (float)(track->keys[i].frame - track->keys[i-1].frame);
-
-    assert((*u >= 0.0f) && (*u <= 1.0f));
-    return i;
 }
 
 
 static void 
-setup_segment(Lib3dsTrack *track, int index, Lib3dsKey *pp, Lib3dsKey *p0, Lib3dsKey *p1, Lib3dsKey *pn) {
+setup_segment(Lib3dsTrack *track, float (*rotations)[4], int index, Lib3dsKey *pp, Lib3dsKey *p0, Lib3dsKey *p1, Lib3dsKey *pn) {
     int ip = 0;
     int in = 0;
     
@@ -255,12 +240,12 @@ setup_segment(Lib3dsTrack *track, int index, Lib3dsKey *pp, Lib3dsKey *p0, Lib3d
     if (track->type == LIB3DS_TRACK_QUAT) {
         float q[4];
         if (pp->frame >= 0) {
-            quat_for_index(track, ip, pp->value);
+            track_rotation(track, rotations, ip, pp->value);
         } else {
             lib3ds_quat_identity(pp->value);
         }
 
-        quat_for_index(track, index - 1, p0->value);
+        track_rotation(track, rotations, index - 1, p0->value);
         lib3ds_quat_axis_angle(q, track->keys[index].value, track->keys[index].value[3]);
         lib3ds_quat_mul(p1->value, q, p0->value);
 
@@ -274,6 +259,181 @@ setup_segment(Lib3dsTrack *track, int index, Lib3dsKey *pp, Lib3dsKey *p0, Lib3d
 }
 
 
+/*!
+ * Computes the control values of the segment ending at key index: start
+ * value, outgoing tangent, incoming tangent and end value for the Hermite
+ * interpolation, or the control quaternions for squad.
+ */
+static void
+compile_segment(Lib3dsTrack *track, float (*rotations)[4], int index, float seg[4][4]) {
+    Lib3dsKey pp, p0, p1, pn;
+    float dp[4], sp[4], dn[4], sn[4];
+    int i, n;
+
+    setup_segment(track, rotations, index, &pp, &p0, &p1, &pn);
+
+    if (track->type == LIB3DS_TRACK_QUAT) {
+        rot_key_setup(pp.frame>=0? &pp : NULL, &p0, &p1, dp, sp);
+        rot_key_setup(&p0, &p1, pn.frame>=0? &pn : NULL, dn, sn);
+    } else {
+        pos_key_setup(track->type, pp.frame>=0? &pp : NULL, &p0, &p1, dp, sp);
+        pos_key_setup(track->type, &p0, &p1, pn.frame>=0? &pn : NULL, dn, sn);
+    }
+
+    memset(seg, 0, sizeof(float) * 16);
+    n = (track->type == LIB3DS_TRACK_QUAT)? 4 : track->type;
+    for (i = 0; i < n; ++i) {
+        seg[0][i] = p0.value[i];
+        seg[1][i] = dp[i];
+        seg[2][i] = sn[i];
+        seg[3][i] = p1.value[i];
+    }
+}
+
+
+/*!
+ * Copies the control values of the segment ending at key index to seg,
+ * computing them if the track is not compiled.
+ */
+static void
+track_segment(Lib3dsTrack *track, int index, float seg[4][4]) {
+    if (track->cache) {
+        memcpy(seg, track->cache->segments[index - 1], sizeof(float) * 16);
+    } else {
+        compile_segment(track, NULL, index, seg);
+    }
+}
+
+
+/*!
+ * Precomputes the spline tangents of every segment of a track, the
+ * evaluation functions then only look up the segment and interpolate.
+ * The keys of a rotation track hold the rotation relative to the 
+ * previous key, they are accumulated into absolute rotations here 
+ * instead of on every evaluation. Tracks read from a file are already
+ * compiled. Tracks which are not compiled are evaluated from their keys,
+ * evaluation never modifies a track unless its cursor is enabled.
+ *
+ * \param track The track.
+ */
+void
+lib3ds_track_compile(Lib3dsTrack *track) {
+    Lib3dsTrackCache *cache;
+    int i;
+
+    assert(track);
+    if (track->cache) {
+        return;
+    }
+    cache = (Lib3dsTrackCache*)lib3ds_util_heap_calloc(sizeof(Lib3dsTrackCache));
+    if ((track->type == LIB3DS_TRACK_QUAT) && (track->nkeys > 0)) {
+        float q[4], p[4];
+        cache->rotations = (float(*)[4])lib3ds_util_heap_malloc(sizeof(float) * 4 * track->nkeys);
+        lib3ds_quat_identity(q);
+        for (i = 0; i < track->nkeys; ++i) {
+            lib3ds_quat_axis_angle(p, track->keys[i].value, track->keys[i].value[3]);
+            lib3ds_quat_mul(q, p, q);
+            lib3ds_quat_copy(cache->rotations[i], q);
+        }
+    }
+    if ((track->type != LIB3DS_TRACK_BOOL) && (track->nkeys > 1)) {
+        cache->segments = (float(*)[4][4])lib3ds_util_heap_malloc(sizeof(float) * 16 * (track->nkeys - 1));
+        for (i = 1; i < track->nkeys; ++i) {
+            compile_segment(track, cache->rotations, i, cache->segments[i - 1]);
+        }
+    }
+    track->cache = cache;
+}
+
+
+/*!
+ * Enables or disables the evaluation cursor of a track. With the cursor
+ * enabled the track remembers the segment found by the last evaluation
+ * and checks it and the following segment first, so playing a track 
+ * forward costs constant time per evaluation. Otherwise the segment is
+ * found by binary search.
+ *
+ * The cursor is updated by every evaluation, a track using it must not
+ * be evaluated from several threads at the same time.
+ *
+ * \param track The track.
+ * \param enable Non-zero to enable the cursor.
+ */
+void
+lib3ds_track_use_cursor(Lib3dsTrack *track, int enable) {
+    assert(track);
+    track->use_cursor = enable? TRUE : FALSE;
+    track->cursor = 0;
+}
+
+
+/*!
+ * Returns the index of the first key after time t, or -1 and nkeys if t
+ * lies before the first or after the last key, and the position u within
+ * the segment ending at that key. The keys are expected in ascending 
+ * order of their frames. The search starts at the segment ending at
+ * *cursor if cursor is not NULL and stores the segment found there.
+ */
+static int 
+find_index(Lib3dsTrack *track, float t, float *u, int *cursor) {
+    int i, lo, hi;
+    float nt;
+    int t0, t1;
+
+    assert(track);
+    assert(track->nkeys > 0);
+    
+    if (track->nkeys <= 1)
+        return -1;
+    
+    t0 = track->keys[0].frame;
+    t1 = track->keys[track->nkeys-1].frame;
+    if (track->flags & LIB3DS_TRACK_REPEAT) {
+        nt = (float)fmod((float)(t - t0), (float)(t1 - t0)) + t0;
+    } else {
+        nt = t;
+    }
+
+    if (nt <= t0) {
+        return -1;
+    }
+    if (nt >= t1) {
+        return track->nkeys;
+    }
+
+    i = cursor? *cursor : 0;
+    if ((i > 0) && (i < track->nkeys) && (track->keys[i-1].frame <= nt)) {
+        if ((nt >= track->keys[i].frame) && (i + 1 < track->nkeys)) {
+            ++i;
+        }
+    } else {
+        i = 0;
+    }
+    if (!i || (track->keys[i-1].frame > nt) || (nt >= track->keys[i].frame)) {
+        lo = 1;
+        hi = track->nkeys - 1;
+        while (lo < hi) {
+            i = lo + (hi - lo) / 2;
+            if (nt < track->keys[i].frame) {
+                hi = i;
+            } else {
+                lo = i + 1;
+            }
+        }
+        i = lo;
+    }
+    if (cursor) {
+        *cursor = i;
+    }
+
+    *u = nt - (float)track->keys[i-1].frame;
+    *u /= (float)(track->keys[i].frame - track->keys[i-1].frame);
+
+    assert((*u >= 0.0f) && (*u <= 1.0f));
+    return i;
+}
+
+
 void 
 lib3ds_track_eval_bool(Lib3dsTrack *track, int *b, float t) {
     *b = FALSE;
@@ -286,7 +446,7 @@ lib3ds_track_eval_bool(Lib3dsTrack *track, int *b, float t) {
             return;
         }
 
-        index = find_index(track, t, &u);
+        index = find_index(track, t, &u, track->use_cursor? &track->cursor : NULL);
         if (index < 0) {
             *b = FALSE;
             return;
@@ -302,10 +462,9 @@ lib3ds_track_eval_bool(Lib3dsTrack *track, int *b, float t) {
 
 static void 
 track_eval_linear(Lib3dsTrack *track, float *value, float t) {
-    Lib3dsKey pp, p0, p1, pn;
+    float seg[4][4];
     float u;
     int index;
-    float dsp[3], ddp[3], dsn[3], ddn[3];
 
     assert(track);
     if (!track->nkeys) {
@@ -314,7 +473,7 @@ track_eval_linear(Lib3dsTrack *track, float *value, float t) {
         return;
     }
 
-    index = find_index(track, t, &u);
+    index = find_index(track, t, &u, track->use_cursor? &track->cursor : NULL);
 
     if (index < 0) {
         int i;
@@ -327,17 +486,13 @@ track_eval_linear(Lib3dsTrack *track, float *value, float t) {
         return;
     }
 
-    setup_segment(track, index, &pp, &p0, &p1, &pn);
-
-    pos_key_setup(track->type, pp.frame>=0? &pp : NULL, &p0, &p1, ddp, dsp);
-    pos_key_setup(track->type, &p0, &p1, pn.frame>=0? &pn : NULL, ddn, dsn);
-
+    track_segment(track, index, seg);
     lib3ds_math_cubic_interp(
         value,
-        p0.value,
-        ddp,
-        dsn,
-        p1.value,
+        seg[0],
+        seg[1],
+        seg[2],
+        seg[3],
         track->type,
         u
     );
@@ -368,32 +523,234 @@ void
 lib3ds_track_eval_quat(Lib3dsTrack *track, float q[4], float t) {
     lib3ds_quat_identity(q);
     if (track) {
-        Lib3dsKey pp, p0, p1, pn;
+        float seg[4][4];
         float u;
         int index;
-        float ap[4], bp[4], an[4], bn[4];
 
         assert(track->type == LIB3DS_TRACK_QUAT);
         if (!track->nkeys) {
             return;
         }
 
-        index = find_index(track, t, &u);
+        index = find_index(track, t, &u, track->use_cursor? &track->cursor : NULL);
         if (index < 0) {
             lib3ds_quat_axis_angle(q, track->keys[0].value, track->keys[0].value[3]);
             return;
         }
         if (index >= track->nkeys) { 
-            quat_for_index(track, track->nkeys - 1, q);
+            track_rotation(track, track->cache? track->cache->rotations : NULL, track->nkeys - 1, q);
             return;
         }
 
-        setup_segment(track, index, &pp, &p0, &p1, &pn);
+        track_segment(track, index, seg);
+        lib3ds_quat_squad(q, seg[0], seg[1], seg[2], seg[3], u);
+    }
+}
+
+
+#define TRACK_BATCH_SIZE 64
+
+/*!
+ * Angle between two quaternions as computed by lib3ds_quat_slerp(), for
+ * interpolating between the same pair many times.
+ */
+static void
+slerp_setup(float a[4], float b[4], double *om, double *sinom, float *flip) {
+    double l;
+
+    *flip = 1.0f;
+    l = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+    if (l < 0) {
+        *flip = -1.0f;
+        l = -l;
+    }
+    *om = acos(l);
+    *sinom = sin(*om);
+}
+
+
+static void
+slerp_eval(float c[4], float a[4], float b[4], double om, double sinom, float flip, float t) {
+    double sp, sq;
+    int i;
+
+    if (fabs(sinom) > LIB3DS_EPSILON) {
+        sp = sin((1.0f - t) * om) / sinom;
+        sq = sin(t * om) / sinom;
+    } else {
+        sp = 1.0f - t;
+        sq = t;
+    }
+    sq *= flip;
+    for (i = 0; i < 4; ++i) {
+        c[i] = (float)(sp * a[i] + sq * b[i]);
+    }
+}
+
 
-        rot_key_setup(pp.frame>=0? &pp : NULL, &p0, &p1, ap, bp);
-        rot_key_setup(&p0, &p1, pn.frame>=0? &pn : NULL, an, bn);
+/*!
+ * Evaluates n samples which all fall into the segment ending at key
+ * index, or all lie before or after the keys. u holds the positions 
+ * of the samples within the segment.
+ */
+static void
+track_eval_run(Lib3dsTrack *track, int index, const float *u, int n, float *out) {
+    int dim = (track->type == LIB3DS_TRACK_QUAT)? 4 : track->type;
+    float value[4];
+    int i, j;
+
+    if ((index >= 0) && (index < track->nkeys)) {
+        float seg[4][4];
+
+        track_segment(track, index, seg);
+        if (track->type == LIB3DS_TRACK_QUAT) {
+            double om[2], sinom[2];
+            float flip[2], ab[4], pq[4];
+
+            /* squad: the first two slerps always run between the same 
+               quaternions of the segment */
+            slerp_setup(seg[0], seg[3], &om[0], &sinom[0], &flip[0]);
+            slerp_setup(seg[1], seg[2], &om[1], &sinom[1], &flip[1]);
+            for (i = 0; i < n; ++i) {
+                slerp_eval(ab, seg[0], seg[3], om[0], sinom[0], flip[0], u[i]);
+                slerp_eval(pq, seg[1], seg[2], om[1], sinom[1], flip[1], u[i]);
+                lib3ds_quat_slerp(out + 4 * i, ab, pq, 2 * u[i] * (1 - u[i]));
+            }
+        } else {
+            float x[TRACK_BATCH_SIZE], y[TRACK_BATCH_SIZE];
+            float z[TRACK_BATCH_SIZE], w[TRACK_BATCH_SIZE];
+
+            /* Hermite basis as in lib3ds_math_cubic_interp() */
+            for (i = 0; i < n; ++i) {
+                float t = u[i];
+                x[i] = 2 * t * t * t - 3 * t * t + 1;
+                y[i] = -2 * t * t * t + 3 * t * t;
+                z[i] = t * t * t - 2 * t * t + t;
+                w[i] = t * t * t - t * t;
+            }
+            for (j = 0; j < dim; ++j) {
+                for (i = 0; i < n; ++i) {
+                    out[i * dim + j] = x[i] * seg[0][j] + y[i] * seg[3][j] + z[i] * seg[1][j] + w[i] * seg[2][j];
+                }
+            }
+        }
+        return;
+    }
 
-        lib3ds_quat_squad(q, p0.value, ap, bn, p1.value, u);
+    if (track->type == LIB3DS_TRACK_QUAT) {
+        if (index < 0) {
+            lib3ds_quat_axis_angle(value, track->keys[0].value, track->keys[0].value[3]);
+        } else {
+            track_rotation(track, track->cache? track->cache->rotations : NULL, track->nkeys - 1, value);
+        }
+    } else {
+        Lib3dsKey *key = (index < 0)? &track->keys[0] : &track->keys[track->nkeys - 1];
+        for (j = 0; j < dim; ++j) value[j] = key->value[j];
+    }
+    for (i = 0; i < n; ++i) {
+        for (j = 0; j < dim; ++j) out[i * dim + j] = value[j];
+    }
+}
+
+
+static void
+track_eval_batch(Lib3dsTrack *track, const float *times, int n, float *out) {
+    int dim = (track->type == LIB3DS_TRACK_QUAT)? 4 : track->type;
+    int index[TRACK_BATCH_SIZE];
+    float u[TRACK_BATCH_SIZE];
+    int cursor = 1;
+    int i, j, k, m;
+
+    if (!track->nkeys) {
+        return;
+    }
+    for (k = 0; k < n; k += m) {
+        m = (n - k < TRACK_BATCH_SIZE)? n - k : TRACK_BATCH_SIZE;
+        for (i = 0; i < m; ++i) {
+            index[i] = find_index(track, times[k + i], &u[i], &cursor);
+        }
+        for (i = 0; i < m; i = j) {
+            for (j = i + 1; (j < m) && (index[j] == index[i]); ++j);
+            track_eval_run(track, index[i], u + i, j - i, out + (k + i) * dim);
+        }
+    }
+}
+
+
+/*!
+ * Evaluates a float track at n times. The same as calling 
+ * lib3ds_track_eval_float() for every time, but the segment search 
+ * continues from the previous sample and the interpolation runs over all
+ * samples of a segment at once. Sorted times are the fastest. The track
+ * is not modified, compiling it first avoids computing the segments 
+ * again for every call, see lib3ds_track_compile().
+ *
+ * \param track The track, may be NULL.
+ * \param times The times to evaluate the track at.
+ * \param n Number of times.
+ * \param f Receives n values.
+ */
+void
+lib3ds_track_eval_float_batch(Lib3dsTrack *track, const float *times, int n, float *f) {
+    int i;
+    for (i = 0; i < n; ++i) f[i] = 0;
+    if (track) {
+        assert(track->type == LIB3DS_TRACK_FLOAT);
+        track_eval_batch(track, times, n, f);
+    }
+}
+
+
+/*!
+ * Evaluates a boolean track at n times, see lib3ds_track_eval_float_batch().
+ */
+void
+lib3ds_track_eval_bool_batch(Lib3dsTrack *track, const float *times, int n, int *b) {
+    int cursor = 1;
+    int i, index;
+    float u;
+
+    for (i = 0; i < n; ++i) b[i] = FALSE;
+    if (track && track->nkeys) {
+        assert(track->type == LIB3DS_TRACK_BOOL);
+        for (i = 0; i < n; ++i) {
+            index = find_index(track, times[i], &u, &cursor);
+            if (index < 0) {
+                b[i] = FALSE;
+            } else if (index >= track->nkeys) {
+                b[i] = !(track->nkeys & 1);
+            } else {
+                b[i] = !(index & 1);
+            }
+        }
+    }
+}
+
+
+/*!
+ * Evaluates a vector track at n times, see lib3ds_track_eval_float_batch().
+ */
+void
+lib3ds_track_eval_vector_batch(Lib3dsTrack *track, const float *times, int n, float (*v)[3]) {
+    int i;
+    for (i = 0; i < n; ++i) lib3ds_vector_zero(v[i]);
+    if (track) {
+        assert(track->type == LIB3DS_TRACK_VECTOR);
+        track_eval_batch(track, times, n, &v[0][0]);
+    }
+}
+
+
+/*!
+ * Evaluates a rotation track at n times, see lib3ds_track_eval_float_batch().
+ */
+void
+lib3ds_track_eval_quat_batch(Lib3dsTrack *track, const float *times, int n, float (*q)[4]) {
+    int i;
+    for (i = 0; i < n; ++i) lib3ds_quat_identity(q[i]);
+    if (track) {
+        assert(track->type == LIB3DS_TRACK_QUAT);
+        track_eval_batch(track, times, n, &q[0][0]);
     }
 }
 
@@ -450,7 +807,7 @@ lib3ds_track_read(Lib3dsTrack *track, Lib3dsIo *io) {
             for (i = 0; i < nkeys; ++i) {
                 track->keys[i].frame = lib3ds_io_read_intd(io);
                 tcb_read(&track->keys[i], io);
-                lib3ds_io_read_vector(io, track->keys[i].value);
+                lib3ds_io_read_floats(io, track->keys[i].value, 3);
             }
             break;
 
@@ -459,7 +816,7 @@ lib3ds_track_read(Lib3dsTrack *track, Lib3dsIo *io) {
                 track->keys[i].frame = lib3ds_io_read_intd(io);
                 tcb_read(&track->keys[i], io);
                 track->keys[i].value[3] = lib3ds_io_read_float(io);
-                lib3ds_io_read_vector(io, track->keys[i].value);
+                lib3ds_io_read_floats(io, track->keys[i].value, 3);
             }
             break;
 
@@ -474,6 +831,7 @@ lib3ds_track_read(Lib3dsTrack *track, Lib3dsIo *io) {
         default:
             break;
     }
+    lib3ds_track_compile(track);
 }
 
 
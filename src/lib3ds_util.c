@@ -17,12 +17,409 @@
 */
 #include "lib3ds_impl.h"
 
+#if defined(LIB3DS_NO_THREADS)
+#elif defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#if defined(LIB3DS_NO_THREADS)
+#define LIB3DS_THREAD_LOCAL
+#elif defined(_MSC_VER)
+#define LIB3DS_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define LIB3DS_THREAD_LOCAL __thread
+#else
+#define LIB3DS_THREAD_LOCAL
+#endif
+
+#define LIB3DS_ARENA_BLOCK_SIZE (64 * 1024)
+#define LIB3DS_ALIGN(size) (((size) + 15) & ~(size_t)15)
+
+
+/* Memory handed out from an arena is preceded by this header, so
+   realloc knows how much to copy. Heap memory has no header, it is
+   plain memory of the allocator. */
+typedef union Lib3dsAllocHeader {
+    size_t size;
+    double align[2];
+} Lib3dsAllocHeader;
+
+typedef struct Lib3dsArenaBlock {
+    struct Lib3dsArenaBlock *next;
+    Lib3dsArena *arena;
+    size_t size;
+    size_t used;
+} Lib3dsArenaBlock;
+
+struct Lib3dsArena {
+    Lib3dsArenaBlock *blocks;   /* block currently bump allocated from first */
+    size_t block_size;
+};
+
+#define LIB3DS_ARENA_DATA(b) ((char*)(b) + LIB3DS_ALIGN(sizeof(Lib3dsArenaBlock)))
+
+static LIB3DS_THREAD_LOCAL Lib3dsArena *current_arena = NULL;
+
+/* The blocks of all arenas sorted by address, free and realloc look 
+   up whether memory belongs to an arena here. */
+static Lib3dsArenaBlock **arena_blocks = NULL;
+static int arena_nblocks = 0;
+static int arena_blocks_size = 0;
+
+#if defined(LIB3DS_NO_THREADS)
+#elif defined(_WIN32)
+static volatile LONG arena_lock = 0;
+#else
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+static void*
+default_alloc(void *self, size_t size) {
+    (void)self;
+    return malloc(size);
+}
+
+
+static void*
+default_realloc(void *self, void *ptr, size_t size) {
+    (void)self;
+    return realloc(ptr, size);
+}
+
+
+static void
+default_free(void *self, void *ptr) {
+    (void)self;
+    free(ptr);
+}
+
+
+static Lib3dsAllocator allocator = {
+    NULL, default_alloc, default_realloc, default_free
+};
+
+
+/*!
+ * Replaces the functions used for all memory allocated by lib3ds. Must
+ * be called before any lib3ds object is created, since memory is 
+ * always released through the current allocator.
+ *
+ * \param a The allocator, copied. NULL restores malloc, realloc and free.
+ */
+void
+lib3ds_util_set_allocator(const Lib3dsAllocator *a) {
+    if (a) {
+        assert(a->alloc_func && a->realloc_func && a->free_func);
+        allocator = *a;
+    } else {
+        allocator.self = NULL;
+        allocator.alloc_func = default_alloc;
+        allocator.realloc_func = default_realloc;
+        allocator.free_func = default_free;
+    }
+}
+
+
+void
+lib3ds_util_get_allocator(Lib3dsAllocator *a) {
+    assert(a);
+    *a = allocator;
+}
+
+
+void* lib3ds_util_heap_malloc(size_t size) {
+    return (*allocator.alloc_func)(allocator.self, size);
+}
+
+
+void* lib3ds_util_heap_calloc(size_t size) {
+    void *p = (*allocator.alloc_func)(allocator.self, size);
+    if (p) {
+        memset(p, 0, size);
+    }
+    return p;
+}
+
+
+void* lib3ds_util_heap_realloc(void *ptr, size_t size) {
+    if (!ptr) {
+        return (*allocator.alloc_func)(allocator.self, size);
+    }
+    return (*allocator.realloc_func)(allocator.self, ptr, size);
+}
+
+
+void lib3ds_util_heap_free(void *ptr) {
+    if (ptr) {
+        (*allocator.free_func)(allocator.self, ptr);
+    }
+}
+
+
+static void arena_blocks_lock() {
+#if defined(LIB3DS_NO_THREADS)
+#elif defined(_WIN32)
+    while (InterlockedCompareExchange(&arena_lock, 1, 0) != 0) {
+        Sleep(0);
+    }
+#else
+    pthread_mutex_lock(&arena_lock);
+#endif
+}
+
+
+static void arena_blocks_unlock() {
+#if defined(LIB3DS_NO_THREADS)
+#elif defined(_WIN32)
+    InterlockedExchange(&arena_lock, 0);
+#else
+    pthread_mutex_unlock(&arena_lock);
+#endif
+}
+
+
+/* Returns the index of the first block not below ptr. */
+static int
+arena_blocks_search(const void *ptr) {
+    int lo = 0, hi = arena_nblocks;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if ((const char*)arena_blocks[mid] < (const char*)ptr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+
+static int
+arena_blocks_insert(Lib3dsArenaBlock *b) {
+    int i;
+    arena_blocks_lock();
+    if (arena_nblocks >= arena_blocks_size) {
+        int size = arena_blocks_size? 2 * arena_blocks_size : 64;
+        Lib3dsArenaBlock **blocks = (Lib3dsArenaBlock**)lib3ds_util_heap_realloc(
+            arena_blocks, size * sizeof(Lib3dsArenaBlock*));
+        if (!blocks) {
+            arena_blocks_unlock();
+            return FALSE;
+        }
+        arena_blocks = blocks;
+        arena_blocks_size = size;
+    }
+    i = arena_blocks_search(b);
+    memmove(&arena_blocks[i + 1], &arena_blocks[i], (arena_nblocks - i) * sizeof(Lib3dsArenaBlock*));
+    arena_blocks[i] = b;
+    ++arena_nblocks;
+    arena_blocks_unlock();
+    return TRUE;
+}
+
+
+/* Returns the arena ptr was allocated from, NULL for heap memory. */
+static Lib3dsArena*
+arena_find(const void *ptr) {
+    Lib3dsArena *arena = NULL;
+    int i;
+
+    /* memory of an arena can only be passed in after the arena has 
+       been created, no arena needs no lock */
+    if (!arena_nblocks) {
+        return NULL;
+    }
+    arena_blocks_lock();
+    i = arena_blocks_search((const char*)ptr + 1);
+    if (i > 0) {
+        Lib3dsArenaBlock *b = arena_blocks[i - 1];
+        if ((const char*)ptr < LIB3DS_ARENA_DATA(b) + b->size) {
+            arena = b->arena;
+        }
+    }
+    arena_blocks_unlock();
+    return arena;
+}
+
+
+Lib3dsArena* lib3ds_util_arena_new(size_t block_size) {
+    Lib3dsArena *arena = (Lib3dsArena*)lib3ds_util_heap_calloc(sizeof(Lib3dsArena));
+    if (arena) {
+        arena->block_size = block_size? LIB3DS_ALIGN(block_size) : LIB3DS_ARENA_BLOCK_SIZE;
+    }
+    return arena;
+}
+
+
+void lib3ds_util_arena_free(Lib3dsArena *arena) {
+    Lib3dsArenaBlock *b, *next;
+    int i, n = 0;
+
+    assert(arena);
+    arena_blocks_lock();
+    for (i = 0; i < arena_nblocks; ++i) {
+        if (arena_blocks[i]->arena != arena) {
+            arena_blocks[n++] = arena_blocks[i];
+        }
+    }
+    arena_nblocks = n;
+    if (!n) {
+        lib3ds_util_heap_free(arena_blocks);
+        arena_blocks = NULL;
+        arena_blocks_size = 0;
+    }
+    arena_blocks_unlock();
+
+    for (b = arena->blocks; b; b = next) {
+        next = b->next;
+        lib3ds_util_heap_free(b);
+    }
+    lib3ds_util_heap_free(arena);
+}
+
+
+/*!
+ * Makes new allocations of the calling thread come from arena, NULL 
+ * selects the heap.
+ *
+ * \return The previously selected arena, to be restored by the caller.
+ */
+Lib3dsArena* lib3ds_util_arena_set(Lib3dsArena *arena) {
+    Lib3dsArena *previous = current_arena;
+    current_arena = arena;
+    return previous;
+}
+
+
+static void*
+arena_alloc(Lib3dsArena *arena, size_t size) {
+    Lib3dsArenaBlock *b = arena->blocks;
+    char *p;
+
+    size = LIB3DS_ALIGN(size);
+    if (!b || (b->used + size > b->size)) {
+        size_t block_size = (size > arena->block_size / 4)? size : arena->block_size;
+        b = (Lib3dsArenaBlock*)lib3ds_util_heap_malloc(LIB3DS_ALIGN(sizeof(Lib3dsArenaBlock)) + block_size);
+        if (!b) {
+            return NULL;
+        }
+        b->arena = arena;
+        b->size = block_size;
+        b->used = 0;
+        if (!arena_blocks_insert(b)) {
+            lib3ds_util_heap_free(b);
+            return NULL;
+        }
+        if (arena->blocks && (block_size != arena->block_size)) {
+            /* large allocations get a block of their own, the current 
+               block stays in front */
+            b->next = arena->blocks->next;
+            arena->blocks->next = b;
+        } else {
+            b->next = arena->blocks;
+            arena->blocks = b;
+        }
+    }
+    p = LIB3DS_ARENA_DATA(b) + b->used;
+    b->used += size;
+    return p;
+}
+
+
+/*!
+ * Allocates memory owned by lib3ds objects, from the arena selected by
+ * lib3ds_util_arena_set or from the heap. Heap memory is plain memory
+ * of the allocator, so callers may also free it with the allocator.
+ */
+void* lib3ds_util_malloc(size_t size) {
+    Lib3dsAllocHeader *p;
+    if (!current_arena) {
+        return lib3ds_util_heap_malloc(size);
+    }
+    p = (Lib3dsAllocHeader*)arena_alloc(current_arena, sizeof(Lib3dsAllocHeader) + size);
+    if (!p) {
+        return NULL;
+    }
+    p->size = size;
+    return p + 1;
+}
+
+
+void* lib3ds_util_calloc(size_t size) {
+    void *p = lib3ds_util_malloc(size);
+    if (p) {
+        memset(p, 0, size);
+    }
+    return p;
+}
+
+
+/*!
+ * Resizes memory from lib3ds_util_malloc. Memory stays in the arena it
+ * was allocated from, the most recent allocation of an arena is grown
+ * in place if possible.
+ */
+void* lib3ds_util_realloc(void *ptr, size_t size) {
+    Lib3dsAllocHeader *p, *q;
+    Lib3dsArena *arena;
+    Lib3dsArenaBlock *b;
+    char *end;
+
+    if (!ptr) {
+        return lib3ds_util_malloc(size);
+    }
+    arena = arena_find(ptr);
+    if (!arena) {
+        return lib3ds_util_heap_realloc(ptr, size);
+    }
+
+    p = (Lib3dsAllocHeader*)ptr - 1;
+    if (size <= p->size) {
+        p->size = size;
+        return ptr;
+    }
+    b = arena->blocks;
+    end = (char*)p + LIB3DS_ALIGN(sizeof(Lib3dsAllocHeader) + size);
+    if (((char*)p + LIB3DS_ALIGN(sizeof(Lib3dsAllocHeader) + p->size) == LIB3DS_ARENA_DATA(b) + b->used) &&
+        (end <= LIB3DS_ARENA_DATA(b) + b->size)) {
+        b->used = end - LIB3DS_ARENA_DATA(b);
+        p->size = size;
+        return ptr;
+    }
+    q = (Lib3dsAllocHeader*)arena_alloc(arena, sizeof(Lib3dsAllocHeader) + size);
+    if (!q) {
+        return NULL;
+    }
+    memcpy(q + 1, ptr, p->size);
+    q->size = size;
+    return q + 1;
+}
+
+
+/*!
+ * Frees memory from lib3ds_util_malloc. Arena memory is only released
+ * together with its arena.
+ */
+void lib3ds_util_free(void *ptr) {
+    if (ptr && !arena_find(ptr)) {
+        lib3ds_util_heap_free(ptr);
+    }
+}
+
 
 void* lib3ds_util_realloc_array(void *ptr, int old_size, int new_size, int element_size) {
     if (!ptr)
         old_size = 0;
+    if (!new_size) {
+        lib3ds_util_free(ptr);
+        return NULL;
+    }
     if (old_size != new_size) {
-        ptr = realloc(ptr, element_size * new_size);
+        ptr = lib3ds_util_realloc(ptr, element_size * new_size);
         if (old_size < new_size) {
             memset((char*)ptr + element_size * old_size, 0, element_size * (new_size - old_size));
         }
@@ -41,7 +438,12 @@ void lib3ds_util_reserve_array(void ***ptr, int *n, int *size, int new_size, int
                 (*ptr)[i] = 0;
             }
         }
-        *ptr = (void**)realloc(*ptr, sizeof(void*) * new_size);
+        if (new_size) {
+            *ptr = (void**)lib3ds_util_realloc(*ptr, sizeof(void*) * new_size);
+        } else {
+            lib3ds_util_free(*ptr);
+            *ptr = NULL;
+        }
         *size = new_size;
         if (*n > new_size) {
             *n = new_size;
@@ -80,10 +482,158 @@ void lib3ds_util_remove_array(void ***ptr, int *n, int index, Lib3dsFreeFunc fre
     assert(ptr && n);
     if ((index >= 0) && (index < *n)) {
         assert(*ptr);
-        free_func((*ptr)[index]);
+        if (free_func) {
+            free_func((*ptr)[index]);
+        }
         if (index < *n - 1) {
             memmove(&(*ptr)[index], &(*ptr)[index+1], sizeof(void*) * (*n - index - 1));
         }
         *n = *n - 1;
     }
 }
+
+
+/*!
+ * Returns the number of processors available, 1 if unknown or if
+ * lib3ds was built without thread support.
+ */
+int lib3ds_util_num_cpus() {
+#if defined(LIB3DS_NO_THREADS)
+    return 1;
+#elif defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (info.dwNumberOfProcessors > 0)? (int)info.dwNumberOfProcessors : 1;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0)? (int)n : 1;
+#else
+    return 1;
+#endif
+}
+
+
+typedef struct Lib3dsParallel {
+    int n;
+    int next;
+    Lib3dsWorkFunc func;
+    void *self;
+#if defined(LIB3DS_NO_THREADS)
+#elif defined(_WIN32)
+    CRITICAL_SECTION lock;
+#else
+    pthread_mutex_t lock;
+#endif
+} Lib3dsParallel;
+
+
+static int parallel_next(Lib3dsParallel *p) {
+    int i;
+#if defined(LIB3DS_NO_THREADS)
+    i = p->next++;
+#elif defined(_WIN32)
+    EnterCriticalSection(&p->lock);
+    i = p->next++;
+    LeaveCriticalSection(&p->lock);
+#else
+    pthread_mutex_lock(&p->lock);
+    i = p->next++;
+    pthread_mutex_unlock(&p->lock);
+#endif
+    return i;
+}
+
+
+static void parallel_run(Lib3dsParallel *p) {
+    int i;
+    while ((i = parallel_next(p)) < p->n) {
+        (*p->func)(p->self, i);
+    }
+}
+
+
+#if defined(LIB3DS_NO_THREADS)
+#elif defined(_WIN32)
+static DWORD WINAPI parallel_thread(LPVOID arg) {
+    parallel_run((Lib3dsParallel*)arg);
+    return 0;
+}
+#else
+static void* parallel_thread(void *arg) {
+    parallel_run((Lib3dsParallel*)arg);
+    return NULL;
+}
+#endif
+
+
+/*!
+ * Calls func(self, i) for every i in [0, n) using up to nthreads 
+ * threads, the calling thread included. Work items are handed out in
+ * ascending order. Runs serially if nthreads is 1, threads can not be
+ * created or lib3ds was built with LIB3DS_NO_THREADS.
+ *
+ * \param n        Number of work items.
+ * \param nthreads Number of threads, 0 for lib3ds_util_num_cpus().
+ * \param func     Function processing a single item.
+ * \param self     Passed to func.
+ */
+void lib3ds_util_parallel_for(int n, int nthreads, Lib3dsWorkFunc func, void *self) {
+    Lib3dsParallel p;
+
+    p.n = n;
+    p.next = 0;
+    p.func = func;
+    p.self = self;
+    if (nthreads <= 0) {
+        nthreads = lib3ds_util_num_cpus();
+    }
+    if (nthreads > n) {
+        nthreads = n;
+    }
+
+#if defined(LIB3DS_NO_THREADS)
+    parallel_run(&p);
+#elif defined(_WIN32)
+    InitializeCriticalSection(&p.lock);
+    if (nthreads > 1) {
+        HANDLE *threads = (HANDLE*)lib3ds_util_heap_calloc((nthreads - 1) * sizeof(HANDLE));
+        int i, nstarted = 0;
+
+        for (i = 0; i < nthreads - 1; ++i) {
+            threads[nstarted] = CreateThread(NULL, 0, parallel_thread, &p, 0, NULL);
+            if (threads[nstarted]) {
+                ++nstarted;
+            }
+        }
+        parallel_run(&p);
+        WaitForMultipleObjects(nstarted, threads, TRUE, INFINITE);
+        for (i = 0; i < nstarted; ++i) {
+            CloseHandle(threads[i]);
+        }
+        lib3ds_util_heap_free(threads);
+    } else {
+        parallel_run(&p);
+    }
+    DeleteCriticalSection(&p.lock);
+#else
+    pthread_mutex_init(&p.lock, NULL);
+    if (nthreads > 1) {
+        pthread_t *threads = (pthread_t*)lib3ds_util_heap_calloc((nthreads - 1) * sizeof(pthread_t));
+        int i, nstarted = 0;
+
+        for (i = 0; i < nthreads - 1; ++i) {
+            if (pthread_create(&threads[nstarted], NULL, parallel_thread, &p) == 0) {
+                ++nstarted;
+            }
+        }
+        parallel_run(&p);
+        for (i = 0; i < nstarted; ++i) {
+            pthread_join(threads[i], NULL);
+        }
+        lib3ds_util_heap_free(threads);
+    } else {
+        parallel_run(&p);
+    }
+    pthread_mutex_destroy(&p.lock);
+#endif
+}